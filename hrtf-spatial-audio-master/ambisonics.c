@@ -0,0 +1,551 @@
+// Ambisonics bus
+// See ambisonics.h
+
+#include "ambisonics.h"
+#include "kiss_fftr.h"
+#include "simd.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Tikhonov term of the decoder fit, relative to the mean diagonal of the
+// normal equations
+#define AMBISONICS_REGULARISATION 1e-3
+
+// Above this frequency, in Hz, the decoder only fits the HRIRs' magnitude
+#define AMBISONICS_MAGNITUDE_FREQ 2000.0f
+
+// Band ambisonics_decoder_error() compares over, in Hz
+#define AMBISONICS_ERROR_LOW 100.0f
+#define AMBISONICS_ERROR_HIGH 16000.0f
+
+// A measured direction on the full sphere, mirrored ones included
+typedef struct _sh_direction {
+    int position;
+    bool swap;              // Mirrored: the position's ears swapped
+    double weight;          // Area of the sphere it stands for
+    float coeffs[AMBISONICS_MAX_CHANNELS];
+} sh_direction;
+
+// Every direction of a set with the spectra of its HRIRs
+typedef struct _sh_fit {
+    int num_directions;
+    sh_direction* directions;
+    int fft_size;           // Twice the HRIRs or more, a power of two
+    int num_bins;           // fft_size / 2 + 1
+    kiss_fftr_cfg forward;
+    kiss_fftr_cfg inverse;
+    kiss_fft_cpx* spectra;  // Left then right ear of each direction, as heard from it
+    float* time;            // fft_size samples
+} sh_fit;
+
+int ambisonics_channels(int order) {
+    return (order + 1) * (order + 1);
+}
+
+void ambisonics_encode(int order, float azimuth, float elevation, float* coeffs) {
+    double x = sin(elevation * M_PI / 180);
+    double y = cos(elevation * M_PI / 180);
+
+    // cos(m azimuth) and sin(m azimuth) by the angle sum recurrence
+    double cos_m[AMBISONICS_MAX_ORDER + 1], sin_m[AMBISONICS_MAX_ORDER + 1];
+    cos_m[0] = 1;
+    sin_m[0] = 0;
+    cos_m[1] = cos(azimuth * M_PI / 180);
+    sin_m[1] = sin(azimuth * M_PI / 180);
+    for (int m = 2; m <= order; m++) {
+        cos_m[m] = 2 * cos_m[1] * cos_m[m - 1] - cos_m[m - 2];
+        sin_m[m] = 2 * cos_m[1] * sin_m[m - 1] - sin_m[m - 2];
+    }
+
+    // Associated Legendre functions P(n, m) of sin(elevation), without the
+    // Condon-Shortley phase
+    double p[AMBISONICS_MAX_ORDER + 1][AMBISONICS_MAX_ORDER + 1];
+    p[0][0] = 1;
+    for (int m = 1; m <= order; m++) {
+        p[m][m] = (2 * m - 1) * y * p[m - 1][m - 1];
+    }
+    for (int m = 0; m < order; m++) {
+        p[m + 1][m] = (2 * m + 1) * x * p[m][m];
+        for (int n = m + 2; n <= order; n++) {
+            p[n][m] = ((2 * n - 1) * x * p[n - 1][m] - (n + m - 1) * p[n - 2][m]) / (n - m);
+        }
+    }
+
+    for (int n = 0; n <= order; n++) {
+        // N3D: sqrt((2n + 1) (2 - delta(m)) (n - m)! / (n + m)!), squared
+        double norm = 2 * n + 1;
+        coeffs[n * n + n] = (float)(sqrt(norm) * p[n][0]);
+        norm *= 2;
+        for (int m = 1; m <= n; m++) {
+            norm /= (double)(n + m) * (n - m + 1);
+            double value = sqrt(norm) * p[n][m];
+            coeffs[n * n + n + m] = (float)(value * cos_m[m]);
+            coeffs[n * n + n - m] = (float)(value * sin_m[m]);
+        }
+    }
+}
+
+typedef void (*ambisonics_add_fn)(int num_channels, const float* gains, const float* changes,
+                                  const float* in, float* bus, int stride, int n);
+
+// Samples `first` to n - 1 of ambisonics_add(), the remainder of the SIMD
+// kernels
+static void add_scalar(int num_channels, const float* gains, const float* changes,
+                       const float* in, float* bus, int stride, int first, int n) {
+    float scale = 1.0f / n;
+    for (int c = 0; c < num_channels; c++) {
+        float* out = bus + (size_t)c * stride;
+        for (int i = first; i < n; i++) {
+            out[i] += (gains[c] + changes[c] * ((i + 1) * scale)) * in[i];
+        }
+    }
+}
+
+static void ambisonics_add_scalar(int num_channels, const float* gains, const float* changes,
+                                  const float* in, float* bus, int stride, int n) {
+    add_scalar(num_channels, gains, changes, in, bus, stride, 0, n);
+}
+
+// The SIMD kernels work through the input a few vectors at a time: they
+// load them, and the same times the ramp, once, then add them into each
+// channel in turn, so each channel costs two multiply-adds per vector and
+// its row of the bus is written in one run. Going across the channels a
+// vector at a time instead would touch rows a power of two apart, which
+// share cache sets and evict each other from about 16 channels on.
+#define AMBISONICS_TILE 8
+
+#ifdef SIMD_X86
+SIMD_TARGET("sse2")
+static void ambisonics_add_sse2(int num_channels, const float* gains, const float* changes,
+                                const float* in, float* bus, int stride, int n) {
+    __m128 scale = _mm_set1_ps(1.0f / n);
+    __m128 lanes = _mm_setr_ps(1, 2, 3, 4);
+    __m128 x[AMBISONICS_TILE], ramped[AMBISONICS_TILE];
+    int i = 0;
+    while (i + 4 <= n) {
+        int vectors = (n - i) / 4 < AMBISONICS_TILE ? (n - i) / 4 : AMBISONICS_TILE;
+        for (int v = 0; v < vectors; v++) {
+            __m128 ramp = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)(i + v * 4)), lanes), scale);
+            x[v] = _mm_loadu_ps(in + i + v * 4);
+            ramped[v] = _mm_mul_ps(x[v], ramp);
+        }
+        for (int c = 0; c < num_channels; c++) {
+            float* out = bus + (size_t)c * stride + i;
+            __m128 gain = _mm_set1_ps(gains[c]);
+            __m128 change = _mm_set1_ps(changes[c]);
+            for (int v = 0; v < vectors; v++) {
+                __m128 y = _mm_add_ps(_mm_loadu_ps(out + v * 4), _mm_mul_ps(gain, x[v]));
+                _mm_storeu_ps(out + v * 4, _mm_add_ps(y, _mm_mul_ps(change, ramped[v])));
+            }
+        }
+        i += vectors * 4;
+    }
+    add_scalar(num_channels, gains, changes, in, bus, stride, i, n);
+}
+
+SIMD_TARGET("avx2,fma")
+static void ambisonics_add_avx2(int num_channels, const float* gains, const float* changes,
+                                const float* in, float* bus, int stride, int n) {
+    __m256 scale = _mm256_set1_ps(1.0f / n);
+    __m256 lanes = _mm256_setr_ps(1, 2, 3, 4, 5, 6, 7, 8);
+    __m256 x[AMBISONICS_TILE], ramped[AMBISONICS_TILE];
+    int i = 0;
+    while (i + 8 <= n) {
+        int vectors = (n - i) / 8 < AMBISONICS_TILE ? (n - i) / 8 : AMBISONICS_TILE;
+        for (int v = 0; v < vectors; v++) {
+            __m256 ramp = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps((float)(i + v * 8)), lanes),
+                                        scale);
+            x[v] = _mm256_loadu_ps(in + i + v * 8);
+            ramped[v] = _mm256_mul_ps(x[v], ramp);
+        }
+        for (int c = 0; c < num_channels; c++) {
+            float* out = bus + (size_t)c * stride + i;
+            __m256 gain = _mm256_set1_ps(gains[c]);
+            __m256 change = _mm256_set1_ps(changes[c]);
+            for (int v = 0; v < vectors; v++) {
+                __m256 y = _mm256_fmadd_ps(gain, x[v], _mm256_loadu_ps(out + v * 8));
+                _mm256_storeu_ps(out + v * 8, _mm256_fmadd_ps(change, ramped[v], y));
+            }
+        }
+        i += vectors * 8;
+    }
+    add_scalar(num_channels, gains, changes, in, bus, stride, i, n);
+}
+#endif
+
+#ifdef SIMD_NEON
+static void ambisonics_add_neon(int num_channels, const float* gains, const float* changes,
+                                const float* in, float* bus, int stride, int n) {
+    float32x4_t scale = vdupq_n_f32(1.0f / n);
+    const float LANES[4] = { 1, 2, 3, 4 };
+    float32x4_t lanes = vld1q_f32(LANES);
+    float32x4_t x[AMBISONICS_TILE], ramped[AMBISONICS_TILE];
+    int i = 0;
+    while (i + 4 <= n) {
+        int vectors = (n - i) / 4 < AMBISONICS_TILE ? (n - i) / 4 : AMBISONICS_TILE;
+        for (int v = 0; v < vectors; v++) {
+            float32x4_t ramp = vmulq_f32(vaddq_f32(vdupq_n_f32((float)(i + v * 4)), lanes),
+                                         scale);
+            x[v] = vld1q_f32(in + i + v * 4);
+            ramped[v] = vmulq_f32(x[v], ramp);
+        }
+        for (int c = 0; c < num_channels; c++) {
+            float* out = bus + (size_t)c * stride + i;
+            for (int v = 0; v < vectors; v++) {
+                float32x4_t y = vmlaq_n_f32(vld1q_f32(out + v * 4), x[v], gains[c]);
+                vst1q_f32(out + v * 4, vmlaq_n_f32(y, ramped[v], changes[c]));
+            }
+        }
+        i += vectors * 4;
+    }
+    add_scalar(num_channels, gains, changes, in, bus, stride, i, n);
+}
+#endif
+
+static ambisonics_add_fn add_kernel = ambisonics_add_scalar;
+static const char* add_name = "scalar";
+
+void ambisonics_init(void) {
+    add_kernel = ambisonics_add_scalar;
+    add_name = "scalar";
+
+#ifdef SIMD_X86
+    if (SDL_HasAVX2() && simd_has_fma()) {
+        add_kernel = ambisonics_add_avx2;
+        add_name = "AVX2";
+    } else if (SDL_HasSSE2()) {
+        add_kernel = ambisonics_add_sse2;
+        add_name = "SSE2";
+    }
+#endif
+#ifdef SIMD_NEON
+    if (SDL_HasNEON()) {
+        add_kernel = ambisonics_add_neon;
+        add_name = "NEON";
+    }
+#endif
+}
+
+const char* ambisonics_kernel_name(void) {
+    return add_name;
+}
+
+void ambisonics_add(int num_channels, const float* gains, const float* changes,
+                    const float* in, float* bus, int stride, int n) {
+    add_kernel(num_channels, gains, changes, in, bus, stride, n);
+}
+
+// A direction's HRIR for one ear, 0 left, 1 right as heard from it
+static const float* direction_hrir(const hrtf_set* set, const sh_direction* direction, int ear) {
+    const hrtf_data* data = &set->positions[direction->position];
+    return (ear == 0) != direction->swap ? data->hrir_l : data->hrir_r;
+}
+
+// Fills in a direction's position, weight and channel gains
+static void list_direction(const hrtf_set* set, int order, const hrtf_ring* ring, int i,
+                           sh_direction* direction) {
+    // The band of elevations half way to the next rings, or all of them
+    // for a set of one ring
+    double band = 1;
+    if (set->num_rings > 1) {
+        double low = fmax(ring->elevation - set->elevation_step / 2.0, -90);
+        double high = fmin(ring->elevation + set->elevation_step / 2.0, 90);
+        band = sin(high * M_PI / 180) - sin(low * M_PI / 180);
+    }
+    direction->swap = i >= ring->num_stored;
+    direction->position = ring->first + (direction->swap ? ring->num_azimuths - i : i);
+    direction->weight = band / ring->num_azimuths;
+
+    const hrtf_data* data = &set->positions[direction->position];
+    int azimuth = direction->swap ? 360 - data->azimuth : data->azimuth;
+    ambisonics_encode(order, (float)azimuth, (float)data->elevation, direction->coeffs);
+}
+
+static void fit_free(sh_fit* fit) {
+    free(fit->directions);
+    free(fit->spectra);
+    free(fit->time);
+    kiss_fftr_free(fit->forward);
+    kiss_fftr_free(fit->inverse);
+    memset(fit, 0, sizeof(sh_fit));
+}
+
+// Zero-pads `len` taps to the fit's FFT size and transforms them
+static void fit_transform(sh_fit* fit, const float* taps, int len, kiss_fft_cpx* spectrum) {
+    memcpy(fit->time, taps, sizeof(float) * len);
+    memset(fit->time + len, 0, sizeof(float) * (fit->fft_size - len));
+    kiss_fftr(fit->forward, fit->time, spectrum);
+}
+
+// Lists every direction of `set` and transforms its HRIRs. Returns 0 on
+// success, -1 if allocation failed.
+static int fit_init(sh_fit* fit, const hrtf_set* set, int order) {
+    memset(fit, 0, sizeof(sh_fit));
+    for (int r = 0; r < set->num_rings; r++) {
+        fit->num_directions += set->rings[r].num_azimuths;
+    }
+    fit->fft_size = 2;
+    while (fit->fft_size < 2 * set->hrir_len) {
+        fit->fft_size *= 2;
+    }
+    fit->num_bins = fit->fft_size / 2 + 1;
+
+    fit->directions = malloc(sizeof(sh_direction) * fit->num_directions);
+    fit->spectra = malloc(sizeof(kiss_fft_cpx) * 2 * fit->num_directions * fit->num_bins);
+    fit->time = malloc(sizeof(float) * fit->fft_size);
+    fit->forward = kiss_fftr_alloc(fit->fft_size, 0, NULL, NULL);
+    fit->inverse = kiss_fftr_alloc(fit->fft_size, 1, NULL, NULL);
+    if (!fit->directions || !fit->spectra || !fit->time || !fit->forward || !fit->inverse) {
+        fit_free(fit);
+        return -1;
+    }
+
+    int d = 0;
+    for (int r = 0; r < set->num_rings; r++) {
+        for (int i = 0; i < set->rings[r].num_azimuths; i++, d++) {
+            sh_direction* direction = &fit->directions[d];
+            list_direction(set, order, &set->rings[r], i, direction);
+            for (int ear = 0; ear < 2; ear++) {
+                fit_transform(fit, direction_hrir(set, direction, ear), set->hrir_len,
+                              fit->spectra + (size_t)(d * 2 + ear) * fit->num_bins);
+            }
+        }
+    }
+    return 0;
+}
+
+// Inverts the n x n matrix `a` into `inverse` by Gauss-Jordan elimination,
+// destroying `a`
+static void invert(double* a, double* inverse, int n) {
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            inverse[i * n + j] = i == j;
+        }
+    }
+    for (int c = 0; c < n; c++) {
+        int pivot = c;
+        for (int r = c + 1; r < n; r++) {
+            if (fabs(a[r * n + c]) > fabs(a[pivot * n + c])) {
+                pivot = r;
+            }
+        }
+        for (int j = 0; j < n; j++) {
+            double swap = a[c * n + j];
+            a[c * n + j] = a[pivot * n + j];
+            a[pivot * n + j] = swap;
+            swap = inverse[c * n + j];
+            inverse[c * n + j] = inverse[pivot * n + j];
+            inverse[pivot * n + j] = swap;
+        }
+        double scale = 1 / a[c * n + c];
+        for (int j = 0; j < n; j++) {
+            a[c * n + j] *= scale;
+            inverse[c * n + j] *= scale;
+        }
+        for (int r = 0; r < n; r++) {
+            double factor = a[r * n + c];
+            if (r == c || factor == 0) {
+                continue;
+            }
+            for (int j = 0; j < n; j++) {
+                a[r * n + j] -= factor * a[c * n + j];
+                inverse[r * n + j] -= factor * inverse[c * n + j];
+            }
+        }
+    }
+}
+
+// The weighted, regularised least squares solution as a k x num_directions
+// matrix: channel c's value for a field is the sum of the field's value in
+// each direction times solution[c][direction]. Returns NULL if allocation
+// failed.
+static double* fit_solution(const sh_fit* fit, int k) {
+    double* normal = malloc(sizeof(double) * k * k);
+    double* inverse = malloc(sizeof(double) * k * k);
+    double* solution = malloc(sizeof(double) * k * fit->num_directions);
+    if (!normal || !inverse || !solution) {
+        free(normal);
+        free(inverse);
+        free(solution);
+        return NULL;
+    }
+
+    memset(normal, 0, sizeof(double) * k * k);
+    for (int d = 0; d < fit->num_directions; d++) {
+        const sh_direction* direction = &fit->directions[d];
+        for (int i = 0; i < k; i++) {
+            for (int j = 0; j < k; j++) {
+                normal[i * k + j] += direction->weight * direction->coeffs[i] *
+                                     direction->coeffs[j];
+            }
+        }
+    }
+    double trace = 0;
+    for (int i = 0; i < k; i++) {
+        trace += normal[i * k + i];
+    }
+    for (int i = 0; i < k; i++) {
+        normal[i * k + i] += AMBISONICS_REGULARISATION * trace / k;
+    }
+    invert(normal, inverse, k);
+
+    for (int c = 0; c < k; c++) {
+        for (int d = 0; d < fit->num_directions; d++) {
+            const sh_direction* direction = &fit->directions[d];
+            double share = 0;
+            for (int j = 0; j < k; j++) {
+                share += inverse[c * k + j] * direction->coeffs[j];
+            }
+            solution[c * fit->num_directions + d] = share * direction->weight;
+        }
+    }
+    free(normal);
+    free(inverse);
+    return solution;
+}
+
+// What the channel spectra `channels`, num_bins each, play at one bin for
+// a source in `direction`
+static kiss_fft_cpx decode_bin(const sh_fit* fit, const kiss_fft_cpx* channels, int k,
+                               const sh_direction* direction, int bin) {
+    kiss_fft_cpx sum = { 0, 0 };
+    for (int c = 0; c < k; c++) {
+        sum.r += direction->coeffs[c] * channels[c * fit->num_bins + bin].r;
+        sum.i += direction->coeffs[c] * channels[c * fit->num_bins + bin].i;
+    }
+    return sum;
+}
+
+int ambisonics_decoder_init(ambisonics_decoder* dec, const hrtf_set* set, int order,
+                            convolver* conv, int head_len) {
+    memset(dec, 0, sizeof(ambisonics_decoder));
+    if (order < 1 || order > AMBISONICS_MAX_ORDER || set->min_phase_len > 0) {
+        return -1;
+    }
+    int k = ambisonics_channels(order);
+    dec->order = order;
+    dec->num_channels = k;
+    dec->hrir_len = set->hrir_len;
+    dec->filter_len = conv->filter_len;
+
+    sh_fit fit;
+    if (fit_init(&fit, set, order) < 0) {
+        return -1;
+    }
+    double* solution = fit_solution(&fit, k);
+    kiss_fft_cpx* channels = malloc(sizeof(kiss_fft_cpx) * k * fit.num_bins);
+    dec->hrirs = calloc(2 * (size_t)k * dec->hrir_len, sizeof(float));
+    // Direct mode has no partitions, keep the allocation non-empty anyway
+    dec->hrtfs = malloc(sizeof(float) * (2 * (size_t)k * dec->filter_len + 1));
+    if (!solution || !channels || !dec->hrirs || !dec->hrtfs) {
+        free(solution);
+        free(channels);
+        fit_free(&fit);
+        ambisonics_decoder_free(dec);
+        return -1;
+    }
+
+    int magnitude_bin = (int)ceilf(AMBISONICS_MAGNITUDE_FREQ * fit.fft_size / set->sample_rate);
+    for (int ear = 0; ear < 2; ear++) {
+        for (int b = 0; b < fit.num_bins; b++) {
+            kiss_fft_cpx next[AMBISONICS_MAX_CHANNELS];
+            memset(next, 0, sizeof(next));
+            for (int d = 0; d < fit.num_directions; d++) {
+                kiss_fft_cpx target = fit.spectra[(size_t)(d * 2 + ear) * fit.num_bins + b];
+                if (b >= magnitude_bin) {
+                    // The HRIR's magnitude with the phase the fit reached a
+                    // bin lower, so the phase stays smooth
+                    kiss_fft_cpx below = decode_bin(&fit, channels, k, &fit.directions[d], b - 1);
+                    float phase = atan2f(below.i, below.r);
+                    float magnitude = hypotf(target.r, target.i);
+                    target.r = magnitude * cosf(phase);
+                    target.i = magnitude * sinf(phase);
+                }
+                for (int c = 0; c < k; c++) {
+                    double share = solution[c * fit.num_directions + d];
+                    next[c].r += (float)(share * target.r);
+                    next[c].i += (float)(share * target.i);
+                }
+            }
+            for (int c = 0; c < k; c++) {
+                channels[c * fit.num_bins + b] = next[c];
+            }
+        }
+
+        // Back to taps, cut to the set's length
+        for (int c = 0; c < k; c++) {
+            kiss_fftri(fit.inverse, channels + c * fit.num_bins, fit.time);
+            float* filter = dec->hrirs + (size_t)(c * 2 + ear) * dec->hrir_len;
+            for (int t = 0; t < dec->hrir_len; t++) {
+                filter[t] = fit.time[t] / fit.fft_size;
+            }
+        }
+    }
+
+    // Partitioned like the set's own spectra, the first head_len taps are
+    // run directly and left out
+    int tail = dec->hrir_len > head_len ? dec->hrir_len - head_len : 0;
+    for (int f = 0; f < 2 * k; f++) {
+        convolver_make_hrtf(conv, dec->hrirs + (size_t)f * dec->hrir_len + head_len, tail, 1,
+                            dec->hrtfs + (size_t)f * dec->filter_len);
+    }
+
+    free(solution);
+    free(channels);
+    fit_free(&fit);
+    return 0;
+}
+
+void ambisonics_decoder_free(ambisonics_decoder* dec) {
+    free(dec->hrirs);
+    free(dec->hrtfs);
+    memset(dec, 0, sizeof(ambisonics_decoder));
+}
+
+float ambisonics_decoder_error(const ambisonics_decoder* dec, const hrtf_set* set) {
+    sh_fit fit;
+    if (fit_init(&fit, set, dec->order) < 0) {
+        return 0;
+    }
+    kiss_fft_cpx* channels = malloc(sizeof(kiss_fft_cpx) * dec->num_channels * fit.num_bins);
+    if (!channels) {
+        fit_free(&fit);
+        return 0;
+    }
+
+    int first_bin = (int)ceilf(AMBISONICS_ERROR_LOW * fit.fft_size / set->sample_rate);
+    int last_bin = (int)(AMBISONICS_ERROR_HIGH * fit.fft_size / set->sample_rate);
+    if (last_bin > fit.num_bins - 1) {
+        last_bin = fit.num_bins - 1;
+    }
+    double sum = 0;
+    double weights = 0;
+    for (int ear = 0; ear < 2; ear++) {
+        for (int c = 0; c < dec->num_channels; c++) {
+            fit_transform(&fit, dec->hrirs + (size_t)(c * 2 + ear) * dec->hrir_len,
+                          dec->hrir_len, channels + c * fit.num_bins);
+        }
+        for (int d = 0; d < fit.num_directions; d++) {
+            const kiss_fft_cpx* measured = fit.spectra + (size_t)(d * 2 + ear) * fit.num_bins;
+            for (int b = first_bin; b <= last_bin; b++) {
+                kiss_fft_cpx decoded = decode_bin(&fit, channels, dec->num_channels,
+                                                  &fit.directions[d], b);
+                // Floored, so a notch missed by a little does not dominate
+                double ratio = (hypot(decoded.r, decoded.i) + 1e-6) /
+                               (hypot(measured[b].r, measured[b].i) + 1e-6);
+                double level = 20 * log10(ratio);
+                sum += fit.directions[d].weight * level * level;
+                weights += fit.directions[d].weight;
+            }
+        }
+    }
+    free(channels);
+    fit_free(&fit);
+    return (float)sqrt(sum / weights);
+}
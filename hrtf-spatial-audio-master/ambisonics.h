@@ -0,0 +1,77 @@
+// Ambisonics bus
+// Per-source HRTFs cost a convolution per source. On the bus, a source
+// only costs a gain per spherical harmonic channel: its samples are added
+// into (order + 1)^2 channels, each scaled by that harmonic's value in the
+// source's direction. The bus is then rendered to the ears by one fixed
+// filter per channel and ear, so the convolutions are the same for one
+// source or a thousand.
+//
+// Channels are in ACN order with N3D normalisation (channel 0 is the
+// source itself). Adding a source into the bus is ambisonics_add(), which
+// loads each input sample once for all the channels, in SIMD registers
+// where the CPU has them (see simd.h). The decoder's filters are fitted to
+// a measured HRTF set at load time, bin by bin: they are the regularised
+// least squares solution making a plane wave from each measured direction
+// (mirrored ones included, each weighted by the area of the sphere it
+// stands for) come out as that direction's HRTFs. A set of one ring only
+// pins down the harmonics on its plane, and the regularisation keeps the
+// others small.
+//
+// Low orders cannot follow the phase of HRTFs at high frequencies, where
+// the interaural delay turns it round many times across directions, and a
+// fit to it comes out far too quiet. Above 2 kHz only the magnitude is
+// fitted, with each direction's phase carried on from what the fit gave
+// the bin below (magnitude least squares). The interaural delay is then
+// only right at low frequencies, where it matters most, and the bus still
+// blurs directions that the per-source filters keep sharp.
+// ambisonics_decoder_error() measures by how much.
+
+#ifndef AMBISONICS_H
+#define AMBISONICS_H
+
+#include "hrtf_cache.h"
+
+#define AMBISONICS_MAX_ORDER 5
+#define AMBISONICS_MAX_CHANNELS ((AMBISONICS_MAX_ORDER + 1) * (AMBISONICS_MAX_ORDER + 1))
+
+typedef struct _ambisonics_decoder {
+    int order;
+    int num_channels;       // (order + 1)^2
+    int hrir_len;
+    float* hrirs;           // Left then right filter of each channel, hrir_len taps each
+    float* hrtfs;           // Their spectra from head_len on, filter_len floats each
+    int filter_len;
+} ambisonics_decoder;
+
+int ambisonics_channels(int order);
+
+// Channel gains for a source at (azimuth, elevation), in degrees
+void ambisonics_encode(int order, float azimuth, float elevation, float* coeffs);
+
+// Chooses the ambisonics_add() kernel. Whatever sets up a bus calls it
+// first.
+void ambisonics_init(void);
+const char* ambisonics_kernel_name(void);
+
+// Adds `n` samples of a source into a bus of `num_channels` channels
+// `stride` floats apart, with each channel's gain ramping linearly from
+// gains[c] to gains[c] + changes[c] at the last sample:
+//     bus[c * stride + i] += (gains[c] + changes[c] * (i + 1) / n) * in[i]
+void ambisonics_add(int num_channels, const float* gains, const float* changes,
+                    const float* in, float* bus, int stride, int n);
+
+// Fits the decoder's filters to the measured HRIRs of `set` (min_phase_len
+// 0), and makes their spectra with `conv` for a render graph that runs the
+// first `head_len` taps directly. Returns 0 on success, -1 if the order is
+// out of range, the set is not measured or allocation failed.
+int ambisonics_decoder_init(ambisonics_decoder* dec, const hrtf_set* set, int order,
+                            convolver* conv, int head_len);
+void ambisonics_decoder_free(ambisonics_decoder* dec);
+
+// Log-spectral distance between what the decoder plays for a source at
+// each measured direction and that direction's HRTFs: the RMS difference
+// of their levels in dB from 100 Hz to 16 kHz, over every direction and
+// ear, weighted like the fit. The per-source filters are at 0.
+float ambisonics_decoder_error(const ambisonics_decoder* dec, const hrtf_set* set);
+
+#endif
@@ -0,0 +1,177 @@
+// Streaming HRTF convolution
+// See convolver.h
+
+#include "convolver.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int convolver_num_partitions(int block_size, int hrir_len) {
+    return (hrir_len + block_size - 1) / block_size;
+}
+
+int convolver_init(convolver* conv, int block_size, int hrir_len) {
+    memset(conv, 0, sizeof(convolver));
+
+    if (block_size < CONVOLVER_MIN_BLOCK || block_size > CONVOLVER_MAX_BLOCK) {
+        return -1;
+    }
+
+    conv->block_size = block_size;
+    conv->fft_size = 2 * block_size;
+    conv->num_bins = conv->fft_size / 2 + 1;
+    conv->padded_bins = spectrum_padded_bins(conv->num_bins);
+    conv->spectrum_len = 2 * conv->padded_bins;
+    conv->num_partitions = convolver_num_partitions(block_size, hrir_len);
+    conv->filter_len = conv->num_partitions * conv->spectrum_len;
+    conv->tail_len = conv->fft_size - block_size;
+
+    conv->time_in = malloc(sizeof(float) * CONVOLVER_BATCH * block_size);
+    conv->time_out = malloc(sizeof(float) * CONVOLVER_BATCH * conv->fft_size);
+
+    spectrum_init();
+
+    if (fft_batch_init(&conv->fft, conv->fft_size) != 0 || !conv->time_in || !conv->time_out) {
+        convolver_free(conv);
+        return -1;
+    }
+    return 0;
+}
+
+void convolver_free(convolver* conv) {
+    fft_batch_free(&conv->fft);
+    free(conv->time_in);
+    free(conv->time_out);
+    memset(conv, 0, sizeof(convolver));
+}
+
+void convolver_make_hrtf(convolver* conv, const float* hrir, int hrir_len, int stride,
+                         float* hrtf) {
+    // kiss_fft's inverse transform is unscaled, so the 1/N is folded into
+    // the filter once here instead of into every output sample
+    const float scale = 1.0f / conv->fft_size;
+
+    // Each partition is one block of taps, zero-padded to the FFT size,
+    // and up to CONVOLVER_BATCH of them are transformed at once
+    for (int first = 0; first < conv->num_partitions; first += CONVOLVER_BATCH) {
+        const float* in[CONVOLVER_BATCH];
+        float* spectra[CONVOLVER_BATCH];
+        int count = conv->num_partitions - first;
+        if (count > CONVOLVER_BATCH) {
+            count = CONVOLVER_BATCH;
+        }
+
+        for (int k = 0; k < count; k++) {
+            int offset = (first + k) * conv->block_size;
+            float* block = conv->time_in + k * conv->block_size;
+
+            for (int i = 0; i < conv->block_size; i++) {
+                block[i] = (offset + i < hrir_len) ? hrir[(offset + i) * stride] * scale : 0;
+            }
+            in[k] = block;
+            spectra[k] = hrtf + (first + k) * conv->spectrum_len;
+        }
+        fft_batch_forward(&conv->fft, count, in, conv->block_size, spectra, conv->padded_bins);
+    }
+}
+
+void convolver_analyze(convolver* conv, int count, const float* const in[], int n,
+                       float* const spectra[]) {
+    fft_batch_forward(&conv->fft, count, in, n, spectra, conv->padded_bins);
+
+    conv->stat_transforms += count;
+    conv->stat_batches++;
+}
+
+void convolver_accumulate(convolver* conv, const float* fdl, int head,
+                          const float* hrtf, float* acc, bool clear) {
+    for (int p = 0; p < conv->num_partitions; p++) {
+        // Partition p meets the input block from p blocks ago
+        int slot = (head - p + conv->num_partitions) % conv->num_partitions;
+        const float* x = fdl + slot * conv->spectrum_len;
+        const float* h = hrtf + p * conv->spectrum_len;
+
+        if (clear && p == 0) {
+            spectrum_mul(x, h, acc, conv->padded_bins);
+        } else {
+            spectrum_mac(x, h, acc, conv->padded_bins);
+        }
+    }
+}
+
+void convolver_synthesize(convolver* conv, int count, const float* const acc[],
+                          float* const tail[], float* const out[], int stride, int n) {
+    // Every slot, used or not, so none is left unset
+    float* time_out[CONVOLVER_BATCH];
+    for (int k = 0; k < CONVOLVER_BATCH; k++) {
+        time_out[k] = conv->time_out + k * conv->fft_size;
+    }
+    fft_batch_inverse(&conv->fft, count, acc, conv->padded_bins, time_out);
+    conv->stat_transforms += count;
+    conv->stat_batches++;
+
+    for (int k = 0; k < count; k++) {
+        const float* y = time_out[k];
+        float* t = tail[k];
+
+        for (int i = 0; i < n; i++) {
+            float carried = (i < conv->tail_len) ? t[i] : 0;
+            out[k][i * stride] = y[i] + carried;
+        }
+
+        // Shift what is left of the old tail forward and add the new overlap
+        for (int i = 0; i < conv->tail_len; i++) {
+            float carried = (i + n < conv->tail_len) ? t[i + n] : 0;
+            t[i] = carried + y[n + i];
+        }
+    }
+}
+
+void convolver_crossfade(convolver* conv, int count, const float* const diff[],
+                         float* const out[], int stride, int n) {
+    float* time_out[CONVOLVER_BATCH];
+    for (int k = 0; k < CONVOLVER_BATCH; k++) {
+        time_out[k] = conv->time_out + k * conv->fft_size;
+    }
+    fft_batch_inverse(&conv->fft, count, diff, conv->padded_bins, time_out);
+    conv->stat_transforms += count;
+    conv->stat_batches++;
+
+    for (int k = 0; k < count; k++) {
+        const float* d = time_out[k];
+        for (int i = 0; i < n; i++) {
+            out[k][i * stride] += (1 - convolver_fade_gain(i, n)) * d[i];
+        }
+    }
+}
+
+float convolver_fade_gain(int i, int n) {
+    return 0.5f - 0.5f * cosf(3.14159265f * (i + 0.5f) / n);
+}
+
+void convolver_print_stats(const convolver* conv) {
+    if (!conv->stat_blocks) {
+        return;
+    }
+    double us_per_tick = 1000000.0 / SDL_GetPerformanceFrequency();
+    printf("Convolution: %d-point FFT, %d partitions, %.1f us/block, "
+           "%.1f transforms in %.1f batches/block\n",
+           conv->fft_size, conv->num_partitions, conv->stat_ticks * us_per_tick / conv->stat_blocks,
+           (double)conv->stat_transforms / conv->stat_blocks,
+           (double)conv->stat_batches / conv->stat_blocks);
+    if (conv->stat_fades) {
+        printf("Crossfades: %d filter changes, %.1f us extra each\n", (int)conv->stat_fades,
+               conv->stat_fade_ticks * us_per_tick / conv->stat_fades);
+    }
+}
+
+void convolver_reset_stats(convolver* conv) {
+    conv->stat_blocks = 0;
+    conv->stat_transforms = 0;
+    conv->stat_batches = 0;
+    conv->stat_ticks = 0;
+    conv->stat_fades = 0;
+    conv->stat_fade_ticks = 0;
+}
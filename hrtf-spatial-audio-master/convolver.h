@@ -0,0 +1,105 @@
+// Streaming HRTF convolution
+// Uniformly partitioned overlap-add convolution: HRIRs are cut into
+// partitions of one block each, and every block is zero-padded to twice the
+// block size, so each block-by-partition product is a linear convolution.
+// The spectra of the last num_partitions input blocks are kept in a
+// frequency-domain delay line (FDL), and partition p of a filter is applied
+// to the block p blocks back. The block size is independent of the HRIR
+// length, which only sets the number of partitions.
+// The part of each block's output that runs past the block is carried over
+// per output channel and added to the start of the next one.
+// Signals are real, so spectra hold fft_size / 2 + 1 bins, kept split into
+// real and imaginary parts (see spectrum.h). Transforms run up to
+// CONVOLVER_BATCH at a time through fft_batch.h, so the analyze and
+// synthesize stages take arrays of blocks.
+//
+// The convolver only holds the transform setup and the three stages of a
+// block; render.h wires them into a graph of sources and output channels.
+
+#ifndef CONVOLVER_H
+#define CONVOLVER_H
+
+#include "SDL2/include/SDL.h"
+#include "fft_batch.h"
+#include "spectrum.h"
+
+#include <stdbool.h>
+
+// Supported block sizes, in samples
+#define CONVOLVER_MIN_BLOCK 32
+#define CONVOLVER_MAX_BLOCK 1024
+
+// Most blocks transformed in one call
+#define CONVOLVER_BATCH FFT_BATCH_WIDTH
+
+typedef struct _convolver {
+    int block_size;         // Input samples per transform, also partition length
+    int fft_size;           // Transform length, 2 * block_size
+    int num_bins;           // fft_size / 2 + 1
+    int padded_bins;        // num_bins rounded up to SPECTRUM_WIDTH
+    int spectrum_len;       // Floats per split spectrum, 2 * padded_bins
+    int num_partitions;     // Partitions per HRIR, also FDL length
+    int filter_len;         // num_partitions * spectrum_len, floats per filter
+    int tail_len;           // Samples carried over to the next block
+
+    fft_batch fft;
+
+    float* time_in;         // CONVOLVER_BATCH partitions of block_size samples
+    float* time_out;        // CONVOLVER_BATCH inverse transformed blocks
+
+    // Instrumentation, reset by convolver_reset_stats()
+    Uint64 stat_blocks;
+    Uint64 stat_transforms;
+    Uint64 stat_batches;    // Calls into the FFT, each of up to CONVOLVER_BATCH transforms
+    Uint64 stat_ticks;
+    Uint64 stat_fades;      // Filter changes crossfaded, counted by render.h
+    Uint64 stat_fade_ticks; // Work done only because of them
+} convolver;
+
+// Number of partitions a `hrir_len` tap filter needs at `block_size`
+int convolver_num_partitions(int block_size, int hrir_len);
+
+// Returns 0 on success, -1 if the block size is out of range or allocation
+// failed. `hrir_len` is the longest filter that will be used.
+int convolver_init(convolver* conv, int block_size, int hrir_len);
+void convolver_free(convolver* conv);
+
+// Computes the filter_len partitioned spectrum of a HRIR.
+// `hrir` holds `hrir_len` samples spaced `stride` floats apart.
+void convolver_make_hrtf(convolver* conv, const float* hrir, int hrir_len, int stride,
+                         float* hrtf);
+
+// Forward transforms `count` <= CONVOLVER_BATCH inputs of `n` <= block_size
+// samples each into `spectra`, in a single batch
+void convolver_analyze(convolver* conv, int count, const float* const in[], int n,
+                       float* const spectra[]);
+
+// acc += sum over p of fdl[head - p] * hrtf[p], bin by bin. `fdl` holds
+// num_partitions spectra, `head` is the slot of the newest one. With
+// `clear` set, acc is overwritten instead of added to.
+void convolver_accumulate(convolver* conv, const float* fdl, int head,
+                          const float* hrtf, float* acc, bool clear);
+
+// Inverse transforms `count` <= CONVOLVER_BATCH spectra in a single batch,
+// and overlap-adds each acc[k] with tail[k] (tail_len samples) into `n`
+// output samples of out[k] spaced `stride` floats apart
+void convolver_synthesize(convolver* conv, int count, const float* const acc[],
+                          float* const tail[], float* const out[], int stride, int n);
+
+// Inverse transforms `count` <= CONVOLVER_BATCH spectra in a single batch,
+// each the difference between what the old and the new filters would have
+// output, and fades it out over the `n` samples of out[k]:
+//     out[k][i * stride] += (1 - convolver_fade_gain(i, n)) * diff[k][i]
+// So a block synthesized with the new filters crossfades from the old ones.
+// The tails are left alone, the next block is all new.
+void convolver_crossfade(convolver* conv, int count, const float* const diff[],
+                         float* const out[], int stride, int n);
+
+// Gain of the new filter at sample i of an n sample crossfade, a raised
+// cosine from 0 to 1
+float convolver_fade_gain(int i, int n);
+
+void convolver_print_stats(const convolver* conv);
+void convolver_reset_stats(convolver* conv);
+
+#endif
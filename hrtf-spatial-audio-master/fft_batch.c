@@ -0,0 +1,160 @@
+// Batched real FFTs
+// See fft_batch.h
+
+#include "fft_batch.h"
+
+#include "SDL2/include/SDL.h"
+
+// kiss_fft's SIMD build relies on GCC/clang vector arithmetic on __m128
+#if defined(__GNUC__) && defined(__SSE__)
+#define FFT_BATCH_SIMD
+#endif
+
+#ifdef FFT_BATCH_SIMD
+// Compile a second, 4-wide copy of kiss_fft into this file. Its public
+// functions are renamed so they do not clash with the scalar build.
+#define USE_SIMD 1
+#define kiss_fft_alloc fft_batch_kiss_fft_alloc
+#define kiss_fft fft_batch_kiss_fft
+#define kiss_fft_stride fft_batch_kiss_fft_stride
+#define kiss_fft_cleanup fft_batch_kiss_fft_cleanup
+#define kiss_fft_next_fast_size fft_batch_kiss_fft_next_fast_size
+#define kiss_fftr_alloc fft_batch_kiss_fftr_alloc
+#define kiss_fftr fft_batch_kiss_fftr
+#define kiss_fftri fft_batch_kiss_fftri
+#include "kiss_fft.c"
+// _kiss_fft_guts.h has no include guard; give its second copy of the
+// state struct a name of its own
+#define kiss_fft_state fft_batch_kiss_fft_state_unused
+#include "kiss_fftr.c"
+#undef kiss_fft_state
+#else
+#include "kiss_fftr.h"
+#endif
+
+int fft_batch_init(fft_batch* batch, int fft_size) {
+    memset(batch, 0, sizeof(fft_batch));
+    batch->fft_size = fft_size;
+    batch->num_bins = fft_size / 2 + 1;
+
+    batch->cfg_forward = kiss_fftr_alloc(fft_size, 0, NULL, NULL);
+    batch->cfg_inverse = kiss_fftr_alloc(fft_size, 1, NULL, NULL);
+
+    // kiss_fft_scalar is FFT_BATCH_WIDTH floats wide in the SIMD build, and
+    // one float otherwise
+    batch->time = SDL_SIMDAlloc(sizeof(kiss_fft_scalar) * fft_size);
+    batch->freq = SDL_SIMDAlloc(sizeof(kiss_fft_cpx) * batch->num_bins);
+
+    if (!batch->cfg_forward || !batch->cfg_inverse || !batch->time || !batch->freq) {
+        fft_batch_free(batch);
+        return -1;
+    }
+    memset(batch->time, 0, sizeof(kiss_fft_scalar) * fft_size);
+    return 0;
+}
+
+void fft_batch_free(fft_batch* batch) {
+    // The SIMD build allocates with _mm_malloc, which kiss_fftr_free gets wrong
+    KISS_FFT_FREE(batch->cfg_forward);
+    KISS_FFT_FREE(batch->cfg_inverse);
+    SDL_SIMDFree(batch->time);
+    SDL_SIMDFree(batch->freq);
+    memset(batch, 0, sizeof(fft_batch));
+}
+
+#ifdef FFT_BATCH_SIMD
+const char* fft_batch_name(void) {
+    return "4-way SSE";
+}
+
+void fft_batch_forward(fft_batch* batch, int count, const float* const in[], int n,
+                       float* const spectra[], int padded_bins) {
+    const int W = FFT_BATCH_WIDTH;
+    float* time = batch->time;
+    const float* freq = batch->freq;
+
+    // Sample i of signal k goes to lane k of time[i]. Unused lanes keep
+    // whatever they held and are never read back.
+    for (int k = 0; k < count; k++) {
+        for (int i = 0; i < n; i++) {
+            time[i * W + k] = in[k][i];
+        }
+        for (int i = n; i < batch->fft_size; i++) {
+            time[i * W + k] = 0;
+        }
+    }
+
+    kiss_fftr(batch->cfg_forward, (const kiss_fft_scalar*)time, (kiss_fft_cpx*)batch->freq);
+
+    // Each bin is W real parts followed by W imaginary parts
+    for (int k = 0; k < count; k++) {
+        float* re = spectra[k];
+        float* im = spectra[k] + padded_bins;
+        for (int b = 0; b < batch->num_bins; b++) {
+            re[b] = freq[b * 2 * W + k];
+            im[b] = freq[b * 2 * W + W + k];
+        }
+        for (int b = batch->num_bins; b < padded_bins; b++) {
+            re[b] = 0;
+            im[b] = 0;
+        }
+    }
+}
+
+void fft_batch_inverse(fft_batch* batch, int count, const float* const spectra[],
+                       int padded_bins, float* const out[]) {
+    const int W = FFT_BATCH_WIDTH;
+    float* freq = batch->freq;
+    const float* time = batch->time;
+
+    for (int k = 0; k < count; k++) {
+        const float* re = spectra[k];
+        const float* im = spectra[k] + padded_bins;
+        for (int b = 0; b < batch->num_bins; b++) {
+            freq[b * 2 * W + k] = re[b];
+            freq[b * 2 * W + W + k] = im[b];
+        }
+    }
+
+    kiss_fftri(batch->cfg_inverse, (const kiss_fft_cpx*)freq, (kiss_fft_scalar*)batch->time);
+
+    for (int k = 0; k < count; k++) {
+        for (int i = 0; i < batch->fft_size; i++) {
+            out[k][i] = time[i * W + k];
+        }
+    }
+}
+#else
+const char* fft_batch_name(void) {
+    return "scalar";
+}
+
+void fft_batch_forward(fft_batch* batch, int count, const float* const in[], int n,
+                       float* const spectra[], int padded_bins) {
+    kiss_fft_cpx* freq = (kiss_fft_cpx*)batch->freq;
+
+    for (int k = 0; k < count; k++) {
+        memcpy(batch->time, in[k], sizeof(float) * n);
+        memset(batch->time + n, 0, sizeof(float) * (batch->fft_size - n));
+        kiss_fftr(batch->cfg_forward, batch->time, freq);
+
+        for (int b = 0; b < padded_bins; b++) {
+            spectra[k][b] = b < batch->num_bins ? freq[b].r : 0;
+            spectra[k][padded_bins + b] = b < batch->num_bins ? freq[b].i : 0;
+        }
+    }
+}
+
+void fft_batch_inverse(fft_batch* batch, int count, const float* const spectra[],
+                       int padded_bins, float* const out[]) {
+    kiss_fft_cpx* freq = (kiss_fft_cpx*)batch->freq;
+
+    for (int k = 0; k < count; k++) {
+        for (int b = 0; b < batch->num_bins; b++) {
+            freq[b].r = spectra[k][b];
+            freq[b].i = spectra[k][padded_bins + b];
+        }
+        kiss_fftri(batch->cfg_inverse, freq, out[k]);
+    }
+}
+#endif
@@ -0,0 +1,41 @@
+// Batched real FFTs
+// kiss_fft built with USE_SIMD uses an __m128 as its scalar type and so
+// transforms four independent signals per call (see
+// deps/kiss_fft130/README.simd). This wraps that build for the convolver:
+// up to FFT_BATCH_WIDTH real signals go in, split spectra (see spectrum.h)
+// come out, and the interleaving is done here.
+// Compilers without SSE vector arithmetic get a plain kiss_fftr per signal.
+
+#ifndef FFT_BATCH_H
+#define FFT_BATCH_H
+
+// Signals per transform
+#define FFT_BATCH_WIDTH 4
+
+typedef struct _fft_batch {
+    int fft_size;
+    int num_bins;           // fft_size / 2 + 1
+    void* cfg_forward;      // kiss_fftr_cfg of the batched build
+    void* cfg_inverse;
+    float* time;            // Interleaved samples, 16-byte aligned
+    float* freq;            // Interleaved bins, 16-byte aligned
+} fft_batch;
+
+// Returns 0 on success, -1 if allocation failed
+int fft_batch_init(fft_batch* batch, int fft_size);
+void fft_batch_free(fft_batch* batch);
+
+// Name of the build in use, for printouts
+const char* fft_batch_name(void);
+
+// Forward transforms `count` <= FFT_BATCH_WIDTH signals of `n` samples each,
+// zero-padded to fft_size, into split spectra of `padded_bins`
+void fft_batch_forward(fft_batch* batch, int count, const float* const in[], int n,
+                       float* const spectra[], int padded_bins);
+
+// Inverse transforms `count` split spectra into fft_size samples each.
+// Like kiss_fftri the result is not scaled by 1 / fft_size.
+void fft_batch_inverse(fft_batch* batch, int count, const float* const spectra[],
+                       int padded_bins, float* const out[]);
+
+#endif
@@ -0,0 +1,152 @@
+// Direct-form FIR kernels
+// See fir.h
+//
+// The SIMD kernels vectorize over output samples: each tap is broadcast and
+// multiplied into a run of consecutive inputs, so taps stay in their natural
+// order and no horizontal sums are needed. Two vectors per ear keep four
+// independent accumulator chains in flight.
+
+#include "fir.h"
+
+#include "simd.h"
+
+void fir_stereo_scalar(const float* x, const float* taps_l, const float* taps_r,
+                       int num_taps, float* out, int n) {
+    for (int i = 0; i < n; i++) {
+        float yl = 0, yr = 0;
+        for (int j = 0; j < num_taps; j++) {
+            yl += taps_l[j] * x[i - j];
+            yr += taps_r[j] * x[i - j];
+        }
+        out[i * 2] += yl;
+        out[i * 2 + 1] += yr;
+    }
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET("sse2")
+static void fir_stereo_sse2(const float* x, const float* taps_l, const float* taps_r,
+                            int num_taps, float* out, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 l0 = _mm_setzero_ps(), l1 = _mm_setzero_ps();
+        __m128 r0 = _mm_setzero_ps(), r1 = _mm_setzero_ps();
+
+        for (int j = 0; j < num_taps; j++) {
+            __m128 hl = _mm_set1_ps(taps_l[j]);
+            __m128 hr = _mm_set1_ps(taps_r[j]);
+            __m128 x0 = _mm_loadu_ps(x + i - j);
+            __m128 x1 = _mm_loadu_ps(x + i + 4 - j);
+            l0 = _mm_add_ps(l0, _mm_mul_ps(hl, x0));
+            r0 = _mm_add_ps(r0, _mm_mul_ps(hr, x0));
+            l1 = _mm_add_ps(l1, _mm_mul_ps(hl, x1));
+            r1 = _mm_add_ps(r1, _mm_mul_ps(hr, x1));
+        }
+
+        // Interleave back into left/right pairs
+        float* o = out + i * 2;
+        _mm_storeu_ps(o, _mm_add_ps(_mm_loadu_ps(o), _mm_unpacklo_ps(l0, r0)));
+        _mm_storeu_ps(o + 4, _mm_add_ps(_mm_loadu_ps(o + 4), _mm_unpackhi_ps(l0, r0)));
+        _mm_storeu_ps(o + 8, _mm_add_ps(_mm_loadu_ps(o + 8), _mm_unpacklo_ps(l1, r1)));
+        _mm_storeu_ps(o + 12, _mm_add_ps(_mm_loadu_ps(o + 12), _mm_unpackhi_ps(l1, r1)));
+    }
+    fir_stereo_scalar(x + i, taps_l, taps_r, num_taps, out + i * 2, n - i);
+}
+
+SIMD_TARGET("avx2,fma")
+static void fir_stereo_avx2(const float* x, const float* taps_l, const float* taps_r,
+                            int num_taps, float* out, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 l0 = _mm256_setzero_ps(), l1 = _mm256_setzero_ps();
+        __m256 r0 = _mm256_setzero_ps(), r1 = _mm256_setzero_ps();
+
+        for (int j = 0; j < num_taps; j++) {
+            __m256 hl = _mm256_broadcast_ss(taps_l + j);
+            __m256 hr = _mm256_broadcast_ss(taps_r + j);
+            __m256 x0 = _mm256_loadu_ps(x + i - j);
+            __m256 x1 = _mm256_loadu_ps(x + i + 8 - j);
+            l0 = _mm256_fmadd_ps(hl, x0, l0);
+            r0 = _mm256_fmadd_ps(hr, x0, r0);
+            l1 = _mm256_fmadd_ps(hl, x1, l1);
+            r1 = _mm256_fmadd_ps(hr, x1, r1);
+        }
+
+        // unpack works within 128-bit lanes, so swap the halves back in order
+        float* o = out + i * 2;
+        __m256 lo0 = _mm256_unpacklo_ps(l0, r0), hi0 = _mm256_unpackhi_ps(l0, r0);
+        __m256 lo1 = _mm256_unpacklo_ps(l1, r1), hi1 = _mm256_unpackhi_ps(l1, r1);
+        __m256 y0 = _mm256_permute2f128_ps(lo0, hi0, 0x20);
+        __m256 y1 = _mm256_permute2f128_ps(lo0, hi0, 0x31);
+        __m256 y2 = _mm256_permute2f128_ps(lo1, hi1, 0x20);
+        __m256 y3 = _mm256_permute2f128_ps(lo1, hi1, 0x31);
+        _mm256_storeu_ps(o, _mm256_add_ps(_mm256_loadu_ps(o), y0));
+        _mm256_storeu_ps(o + 8, _mm256_add_ps(_mm256_loadu_ps(o + 8), y1));
+        _mm256_storeu_ps(o + 16, _mm256_add_ps(_mm256_loadu_ps(o + 16), y2));
+        _mm256_storeu_ps(o + 24, _mm256_add_ps(_mm256_loadu_ps(o + 24), y3));
+    }
+    fir_stereo_sse2(x + i, taps_l, taps_r, num_taps, out + i * 2, n - i);
+}
+#endif
+
+#ifdef SIMD_NEON
+static void fir_stereo_neon(const float* x, const float* taps_l, const float* taps_r,
+                            int num_taps, float* out, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t l0 = vdupq_n_f32(0), l1 = vdupq_n_f32(0);
+        float32x4_t r0 = vdupq_n_f32(0), r1 = vdupq_n_f32(0);
+
+        for (int j = 0; j < num_taps; j++) {
+            float32x4_t x0 = vld1q_f32(x + i - j);
+            float32x4_t x1 = vld1q_f32(x + i + 4 - j);
+            l0 = vmlaq_n_f32(l0, x0, taps_l[j]);
+            r0 = vmlaq_n_f32(r0, x0, taps_r[j]);
+            l1 = vmlaq_n_f32(l1, x1, taps_l[j]);
+            r1 = vmlaq_n_f32(r1, x1, taps_r[j]);
+        }
+
+        float* o = out + i * 2;
+        float32x4x2_t y0 = vzipq_f32(l0, r0);
+        float32x4x2_t y1 = vzipq_f32(l1, r1);
+        vst1q_f32(o, vaddq_f32(vld1q_f32(o), y0.val[0]));
+        vst1q_f32(o + 4, vaddq_f32(vld1q_f32(o + 4), y0.val[1]));
+        vst1q_f32(o + 8, vaddq_f32(vld1q_f32(o + 8), y1.val[0]));
+        vst1q_f32(o + 12, vaddq_f32(vld1q_f32(o + 12), y1.val[1]));
+    }
+    fir_stereo_scalar(x + i, taps_l, taps_r, num_taps, out + i * 2, n - i);
+}
+#endif
+
+static fir_stereo_fn fir_kernel = fir_stereo_scalar;
+static const char* fir_name = "scalar";
+
+void fir_init(void) {
+    fir_kernel = fir_stereo_scalar;
+    fir_name = "scalar";
+
+#ifdef SIMD_X86
+    if (SDL_HasAVX2() && simd_has_fma()) {
+        fir_kernel = fir_stereo_avx2;
+        fir_name = "AVX2";
+    } else if (SDL_HasSSE2()) {
+        fir_kernel = fir_stereo_sse2;
+        fir_name = "SSE2";
+    }
+#endif
+#ifdef SIMD_NEON
+    if (SDL_HasNEON()) {
+        fir_kernel = fir_stereo_neon;
+        fir_name = "NEON";
+    }
+#endif
+}
+
+const char* fir_kernel_name(void) {
+    return fir_name;
+}
+
+void fir_stereo(const float* x, const float* taps_l, const float* taps_r,
+                int num_taps, float* out, int n) {
+    fir_kernel(x, taps_l, taps_r, num_taps, out, n);
+}
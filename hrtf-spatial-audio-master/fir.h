@@ -0,0 +1,27 @@
+// Direct-form FIR kernels
+// Convolves one input with a stereo pair of filters in a single pass, so
+// every input load is shared by both ears:
+//     out[2i]     += sum over j of taps_l[j] * x[i - j]
+//     out[2i + 1] += sum over j of taps_r[j] * x[i - j]
+// x[-(num_taps - 1)] ... x[-1] must be readable history.
+// There are SSE2, AVX2 (with FMA) and NEON versions, see simd.h.
+
+#ifndef FIR_H
+#define FIR_H
+
+typedef void (*fir_stereo_fn)(const float* x, const float* taps_l, const float* taps_r,
+                              int num_taps, float* out, int n);
+
+// Chooses the fir_stereo() kernel, render_init() calls it
+void fir_init(void);
+const char* fir_kernel_name(void);
+
+// Runs the kernel picked by fir_init()
+void fir_stereo(const float* x, const float* taps_l, const float* taps_r,
+                int num_taps, float* out, int n);
+
+// Always available, used for the remainder of the SIMD kernels
+void fir_stereo_scalar(const float* x, const float* taps_l, const float* taps_r,
+                       int num_taps, float* out, int n);
+
+#endif
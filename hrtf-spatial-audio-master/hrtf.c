@@ -9,11 +9,26 @@
 #include <string.h>
 
 #include "kiss_fft.h"
+#include "kiss_fftr.h"
 
 #include "hrtf.h"
-
-const char HRTF_FILE_FORMAT_MIT[] = "mit/elev%d/H%de%03da.wav";
-const char HRTF_FILE_FORMAT_CIPIC[] = "cipic/subject%03d/e%da%03d.wav";
+#include "convolver.h"
+#include "render.h"
+#include "hrtf_cache.h"
+#include "hrtf_interp.h"
+#include "hrtf_loader.h"
+#include "trajectory.h"
+#include "mixer.h"
+#include "param_queue.h"
+#include "render_thread.h"
+#include "task_pool.h"
+#include "fir.h"
+#include "spectrum.h"
+#include "wav_map.h"
+#include "wav_stream.h"
+
+// Written by hrtf_pack, the WAV files are used when it is missing
+const char HRTF_DATABASE_FILE[] = "hrtf.db";
 const char AUDIO_FILE[] = "./beep.wav";
 const char BEE_FILE[] = "./fail-buzzer-01.wav";
 const char StarWar_FILE[] = "./StarWars3.wav";
@@ -22,43 +37,110 @@ const char Train_FILE[] = "./steam-train.wav";// /train-whistle-01.wav";
 const float FPS = 60.0f;
 const float FRAME_TIME = 16.6666667f;   // 1000 / FPS
 
-const int NUM_SAMPLES_PER_FILL = 512;
+// Requested device buffer, also the convolution block size (32 ... 1024)
+const int NUM_SAMPLES_PER_FILL = 128;
+
+// Hybrid mode runs the first HYBRID_BLOCK_SIZE taps as a direct FIR, so the
+// device buffer no longer has to be a whole FFT block
+const int HYBRID_SAMPLES_PER_FILL = 32;
+const int HYBRID_BLOCK_SIZE = 128;
 const int SAMPLE_SIZE = sizeof(float);
-const int FFT_POINTS = 512;             // NUM_SAMPLES_PER_FILL
 
 const int SAMPLE_RATE = 44100;
 
-// Configs for forward and inverse FFT
-kiss_fft_cfg cfg_forward;
-kiss_fft_cfg cfg_inverse;
+// Overlap-add convolver, FFT size is picked from the block and HRIR length
+convolver conv;
+
+// Set with --partitioned, --hybrid or --direct. By default MakeAudio times
+// partitioned and direct rendering at the device's block size and picks one.
+render_mode convolution_mode = RENDER_MODE_AUTO;
+
+// Every sound playing, each through its own source and HRTF pair. For now
+// that is only the audio file.
+#define NUM_VOICES 16
+render_graph graph;
+mixer mix;
+
+// Renders them ahead of the callback, which only copies what is ready.
+// Set with --ahead, the blocks rendered ahead.
+render_thread renderer;
+int render_ahead = 2;
+
+// Spreads each block's sources over this many cores, set with --threads.
+// The output is the same for any number.
+task_pool render_pool;
+int render_threads = 1;
+int file_voice;
 
 // stores which subject HRTF data being used
 int subject = 0;
 
-// Number of samples stored in the audio file
+// Length of the audio file at the device's rate, in whole blocks
 int total_samples = 0;
+
+// Position in the file's loop, for the per-loop stats. Only the render
+// thread touches it while playing; MakeAudio rewinds it.
+int loop_sample = 0;
 double accuracy = 100.0;
 int correct = 0;
 int totalGuess = 0;
 // starting and ending azimuths
 bool testMode = false;
-int azimuth = 0;
+int elevation = 0;      // Degrees, the paths only move in azimuth
 int start = 0, finish = 360;
-int userC;
-int jumpC = 0;
-// FFT storage for convolution with HRTFs during playback
-kiss_fft_cpx* audio_kiss_buf;    // Audio data, time domain
-kiss_fft_cpx* audio_kiss_freq;   // Audio data, stores a single sample, freq domain
-kiss_fft_cpx* audio_kiss_freq_l; // Audio sample multiplied by HRTF, left ear
-kiss_fft_cpx* audio_kiss_freq_r; // Audio sample multiplied by HRTF, right ear
-kiss_fft_cpx* audio_kiss_time_l; // Final, convolved audio sample, left ear
-kiss_fft_cpx* audio_kiss_time_r; // Final, convolved audio sample, right ear
-
-
-// HRTF data for each point on the horizontal plane (0 ... 180)
-const int AZIMUTH_CNT = 37;
-const int AZIMUTH_INCREMENT_DEGREES = 5;
-hrtf_data hrtfs[37];                        // AZIMUTH CNT
+int userC;              // 1 orbits from start instead of going back and forth
+int jumpC = 0;          // Speed level, see AZIMUTH_SPEEDS
+
+// GUI changes reach the render thread through params, between blocks. It
+// only publishes the azimuth it rendered, for the test page.
+typedef enum {
+    PARAM_SPEED,            // Degrees per second
+    PARAM_PATH,             // Start and finish azimuths, and 1 to orbit
+    PARAM_QUIET             // 1 to stop printing every loop
+} param_type;
+param_queue params;
+SDL_atomic_t heard_azimuth;
+
+// Degrees per second at each speed level
+const float AZIMUTH_SPEEDS[] = { 10, 20, 40, 60, 80 };
+// The audio file, mapped and read in place when the mixer can read its
+// samples as they are (see wav_map.h), or read and converted as it plays
+wav_map file_map;
+wav_stream file_stream;
+
+// Samples converted ahead of the callback, about a third of a second
+const int STREAM_RING_SAMPLES = 16384;
+
+
+// Taps of the minimum-phase HRIRs played, set with --taps. 0 plays the
+// measured HRIRs as they are.
+int min_phase_taps = 128;
+
+// Filters blended for directions between the measurements, one per degree
+const float HRTF_INTERP_RESOLUTION = 1.0f;
+
+// Longest onset delay between the ears, in seconds, that the render graph
+// leaves room for, so other subjects' minimum-phase sets can swap in
+const float HRTF_MAX_ITD = 0.001f;
+
+// Holds the interpolated HRTFs played, and swaps in other subjects
+hrtf_loader loader;
+
+// Set with --ambisonics, 1 to 5 mixes every voice into an Ambisonics bus of
+// that order instead of giving each its own HRTFs. The bus is decoded with
+// filters fitted to the subject's measured HRIRs when playback starts, so
+// subject changes wait for the next play.
+int ambisonics_order = 0;
+ambisonics_decoder decoder;
+
+// Set with --vbap, a preset name or a list of speaker directions (see
+// vbap.h) pans every voice onto virtual speakers at the subject's measured
+// positions instead, built when playback starts like the bus
+const char* vbap_speakers = NULL;
+vbap_layout speaker_layout;
+
+// Closed before MakeAudio opens the next one
+SDL_AudioDeviceID current_device = 0;
 
 typedef struct {
     SDL_Rect draw_rect;    // dimensions of button
@@ -82,201 +164,80 @@ static void button_process_event(button_t *btn, const SDL_Event *ev) {
     }
 }
 
-// buf_len should be the number of data point in the stereo `buf`
-// Each sample should have 2 data points; 1 for each ear
-void init_hrtf_data(hrtf_data* data, float* buf, int buf_len, int azimuth, int elevation) {
-    // Initialize properties
-    data->azimuth = azimuth;
-    data->elevation = elevation;
-
-    // Not really necessary to hold on to the HRIR data
-    data->hrir_l = malloc(sizeof(kiss_fft_cpx) * NUM_SAMPLES_PER_FILL);
-    data->hrir_r = malloc(sizeof(kiss_fft_cpx) * NUM_SAMPLES_PER_FILL);
-
-    data->hrtf_l = malloc(sizeof(kiss_fft_cpx) * NUM_SAMPLES_PER_FILL);
-    data->hrtf_r = malloc(sizeof(kiss_fft_cpx) * NUM_SAMPLES_PER_FILL);
-
-    for (int i = 0; i < NUM_SAMPLES_PER_FILL; i++) {
-        if (i < buf_len / 2) {
-            data->hrir_l[i].r = buf[i * 2];
-            data->hrir_r[i].r = buf[(i * 2) + 1];
-        } else {
-            data->hrir_l[i].r = 0;
-            data->hrir_r[i].r = 0;
-        }
-        data->hrir_l[i].i = 0;
-        data->hrir_r[i].i = 0;
+// Back and forth between two azimuths, or round from the first
+static void set_path(trajectory* path, float from, float to, bool orbit, float speed,
+                     int sample_rate) {
+    if (orbit) {
+        trajectory_orbit(path, from, elevation, speed, sample_rate);
+    } else {
+        trajectory_ping_pong(path, from, to, elevation, speed, sample_rate);
     }
-
-    kiss_fft(cfg_forward, data->hrir_l, data->hrtf_l);
-    kiss_fft(cfg_forward, data->hrir_r, data->hrtf_r);
-}
-
-void free_hrtf_data(hrtf_data* data) {
-    free(data->hrir_l);
-    free(data->hrir_r);
-    free(data->hrtf_l);
-    free(data->hrtf_r);
 }
 
-// udata: user data
-// stream: stream to copy into
-// len: number of bytes to copy into stream
-void fill_audio(void* udata, Uint8* stream, int len ) {
-    
-    static int sample = 0;
-   
-    if(azimuth < start ) {
-        azimuth = start;
+// Called on the GUI thread only
+static void send_param(param_type type, float a, float b, float c) {
+    param_command command = { type, { a, b, c } };
+    if (!param_queue_push(&params, &command)) {
+        printf("Control queue full, change dropped\n");
     }
-    
-
-    bool swap = false;
-    static bool reverse = false;
-
-    if (sample >= total_samples) {
-        // azimuth += AZIMUTH_INCREMENT_DEGREES;
-        if(start != finish) {
-        if(reverse) {
-            azimuth -= AZIMUTH_INCREMENT_DEGREES;
-            if(azimuth < start) {
-                reverse = false;
-                azimuth += AZIMUTH_INCREMENT_DEGREES;
-                azimuth += AZIMUTH_INCREMENT_DEGREES;
-            }
-        } else {
-            azimuth += AZIMUTH_INCREMENT_DEGREES;
-            if(azimuth > finish) {
-                reverse = true;
-                azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                azimuth -= AZIMUTH_INCREMENT_DEGREES;
-            }
-        }
-        // No reverse for standard path
-        if(userC == 1){
-
-            reverse = false;
-            azimuth %= 360;
-        }
-
-        }
-        
-        if(jumpC == 1){ // increment by 10
-            if(reverse == false){
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-
-                }else{
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                }
-        }
-        else if(jumpC == 2){ // increment by 20
-            if(reverse == false){
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                }else{
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                }
-
-        }
-        else if(jumpC == 3){    // increment by 30
-            if(reverse == false){
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                }else{
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                }
-
-        }
-        else if(jumpC == 4){    // increment by 40
-            if(reverse == false){
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                    azimuth += AZIMUTH_INCREMENT_DEGREES;
-                }else{
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                    azimuth -= AZIMUTH_INCREMENT_DEGREES;
-                }
-
-        }
-           
-        sample = 0;
+}
 
-        
-        if(testMode == false){
-             printf("Azimuth: %d\n", azimuth);
+// Renders the next num_samples frames into out, on the render thread
+static void render_audio(void* data, float* out, int num_samples) {
+    static bool quiet = false;
+    trajectory* path = &mix.voices[file_voice].path;
+    param_command command;
+    (void)data;
+
+    while (param_queue_pop(&params, &command)) {
+        if (command.type == PARAM_SPEED) {
+            trajectory_set_speed(path, command.values[0]);
+        } else if (command.type == PARAM_PATH) {
+            set_path(path, command.values[0], command.values[1], command.values[2] != 0,
+                     path->speed, path->sample_rate);
+        } else if (command.type == PARAM_QUIET) {
+            quiet = command.values[0] != 0;
         }
-        // only print azimuth value if not testing
     }
 
-    int num_samples = len / SAMPLE_SIZE / 2;
-    if (total_samples - sample < num_samples) {
-        num_samples = total_samples - sample;
-    }
+    // The file just loops, the path runs on its own clock
+    if (loop_sample >= total_samples) {
+        loop_sample = 0;
 
-    int azimuth_idx = azimuth / AZIMUTH_INCREMENT_DEGREES;
-    
-    // Because the HRIR recordings are only from 0-180, we swap them when > 180
-    if(!subject) {
-        if (azimuth > 180) {
-            swap = true;
-            azimuth_idx = 35 - (azimuth_idx % 37);
+        // only print azimuth value if not testing
+        if(quiet == false){
+             printf("Azimuth: %d\n", SDL_AtomicGet(&heard_azimuth));
+             convolver_print_stats(&conv);
+             if (file_stream.underruns > 0) {
+                 printf("Stream underruns: %d\n", file_stream.underruns);
+             }
+             printf("Render ring: %d underruns, %d overruns\n",
+                    SDL_AtomicGet(&renderer.ring.underruns),
+                    SDL_AtomicGet(&renderer.ring.overruns));
         }
+        convolver_reset_stats(&conv);
     }
-    
-    hrtf_data* data = &hrtfs[azimuth_idx];
-
-    kiss_fft_cpx* hrtf_l = data->hrtf_l;
-    kiss_fft_cpx* hrtf_r = data->hrtf_r;
 
-    // Calculate DFT of sample
-    kiss_fft(cfg_forward, audio_kiss_buf + sample, audio_kiss_freq);
+    float path_azimuth, path_elevation;
+    trajectory_direction(path, &path_azimuth, &path_elevation);
+    SDL_AtomicSet(&heard_azimuth, (int)path_azimuth);
 
-    // Apply HRTF
-    for (int i = 0; i < num_samples; i++) {
-        audio_kiss_freq_l[i].r = (audio_kiss_freq[i].r * hrtf_l->r) - (audio_kiss_freq[i].i * hrtf_l->i);
-        audio_kiss_freq_l[i].i = (audio_kiss_freq[i].r * hrtf_l->i) + (audio_kiss_freq[i].i * hrtf_l->r);
-    }
+    // Convolve every voice and write straight into the ring's block
+    mixer_process(&mix, hrtf_loader_live(&loader), out, num_samples);
 
-    for (int i = 0; i < num_samples; i++) {
-        audio_kiss_freq_r[i].r = (audio_kiss_freq[i].r * hrtf_r->r) - (audio_kiss_freq[i].i * hrtf_r->i);
-        audio_kiss_freq_r[i].i = (audio_kiss_freq[i].r * hrtf_r->i) + (audio_kiss_freq[i].i * hrtf_r->r);
+    // Any other subject's filters have faded out
+    if (!render_fading(&graph)) {
+        hrtf_loader_quiescent(&loader);
     }
 
-    // Run reverse FFT to get audio in time domain
-    kiss_fft(cfg_inverse, audio_kiss_freq_l, audio_kiss_time_l);
-    kiss_fft(cfg_inverse, audio_kiss_freq_r, audio_kiss_time_r);
-
-    // Copy data to stream
-    for (int i = 0; i < num_samples; i++) {
-        if (swap) {
-            ((float*)stream)[i * 2] = audio_kiss_time_r[i].r / FFT_POINTS;
-            ((float*)stream)[i * 2 + 1] = audio_kiss_time_l[i].r / FFT_POINTS;
-        } else {
-            ((float*)stream)[i * 2] = audio_kiss_time_l[i].r / FFT_POINTS;
-            ((float*)stream)[i * 2 + 1] = audio_kiss_time_r[i].r / FFT_POINTS;
-        }
-    }
+    loop_sample += num_samples;
+}
 
-    sample += num_samples;
+// udata: user data
+// stream: stream to copy into
+// len: number of bytes to copy into stream
+void fill_audio(void* udata, Uint8* stream, int len ) {
+    render_thread_read(&renderer, (float*)stream, len / SAMPLE_SIZE / 2);
 }
 
 void print_audio_spec(SDL_AudioSpec* spec) {
@@ -332,15 +293,14 @@ void print_audio_spec(SDL_AudioSpec* spec) {
 SDL_AudioDeviceID MakeAudio(int begin, int end, int sound, int choice, int jump){
     SDL_AudioSpec obtained_audio_spec;
     SDL_AudioSpec desired_audio_spec;
-    SDL_AudioCVT audio_cvt;
-    SDL_AudioCVT hrtf_audio_cvt;
     int numDevices, num = 0;
 
     // Audio output format
     desired_audio_spec.freq = SAMPLE_RATE;
     desired_audio_spec.format = AUDIO_F32;
     desired_audio_spec.channels = 2;
-    desired_audio_spec.samples = NUM_SAMPLES_PER_FILL;
+    desired_audio_spec.samples = (convolution_mode == RENDER_MODE_HYBRID) ?
+                                 HYBRID_SAMPLES_PER_FILL : NUM_SAMPLES_PER_FILL;
     desired_audio_spec.callback = fill_audio;
     desired_audio_spec.userdata = NULL;
 
@@ -357,7 +317,24 @@ SDL_AudioDeviceID MakeAudio(int begin, int end, int sound, int choice, int jump)
     }
     printf("Device name: %s\n", device_name[num]);
 
+    // Stops the previous device's callback, then the thread rendering for
+    // it, before their data is replaced
+    if (current_device) {
+        SDL_CloseAudioDevice(current_device);
+    }
+    render_thread_stop(&renderer);
+    hrtf_loader_free(&loader);
+    wav_map_close(&file_map);
+    wav_stream_close(&file_stream);
+    // With nothing rendering the GUI can drain it, the new path already
+    // has everything queued. Quiet is not part of the path, so the test
+    // page's is sent again for the new render thread.
+    param_command stale;
+    while (param_queue_pop(&params, &stale)) {
+    }
+    send_param(PARAM_QUIET, testMode, 0, 0);
     SDL_AudioDeviceID audio_device = SDL_OpenAudioDevice(device_name[num], 0, &desired_audio_spec, &obtained_audio_spec, 0);
+    current_device = audio_device;
 
     printf("Desired Audio Spec:\n");
     print_audio_spec(&desired_audio_spec);
@@ -365,135 +342,168 @@ SDL_AudioDeviceID MakeAudio(int begin, int end, int sound, int choice, int jump)
     printf("Obtained Audio Spec:\n");
     print_audio_spec(&obtained_audio_spec);
 
-    SDL_AudioSpec* file_audio_spec;
-    Uint8* audio_buf;
-    Uint32 audio_len;
-    Uint8* audio_pos;
-    // Open audio file
-    file_audio_spec = malloc(sizeof(SDL_AudioSpec));
-    if (!file_audio_spec) {
-        printf("Failed to allocate audio spec for wav file");
-        return 1;
-    }
-
     // specified audio file is used
+    const char* audio_file = AUDIO_FILE;
     if(sound == 3) {
-        if (!SDL_LoadWAV(BEE_FILE, file_audio_spec, &audio_buf, &audio_len)) {
-            printf("Could not load audio file: %s", BEE_FILE);
-            SDL_Quit();
-           return 1;
-        }
+        audio_file = BEE_FILE;
     } else if(sound == 1){
-        if (!SDL_LoadWAV(StarWar_FILE, file_audio_spec, &audio_buf, &audio_len)) {
-            printf("Could not load audio file: %s", StarWar_FILE);
-            SDL_Quit();
-           return 1;
-        }
+        audio_file = StarWar_FILE;
     }else if(sound == 2){
-        if (!SDL_LoadWAV(Train_FILE, file_audio_spec, &audio_buf, &audio_len)) {
-            printf("Could not load audio file: %s", Train_FILE);
-            SDL_Quit();
-           return 1;
-        }
-    }
-     else {
-        if (!SDL_LoadWAV(AUDIO_FILE, file_audio_spec, &audio_buf, &audio_len)) {
-            printf("Could not load audio file: %s", AUDIO_FILE);
-            SDL_Quit();
-           return 1;
-        }
+        audio_file = Train_FILE;
     }
 
-    printf("Wav Spec:\n");
-    print_audio_spec(file_audio_spec);
-
-
-    // Use mono, the audio will be stereo when the HRTFs are applied
-    SDL_BuildAudioCVT(&audio_cvt,
-                      file_audio_spec->format, file_audio_spec->channels, file_audio_spec->freq,
-                      obtained_audio_spec.format, 1, obtained_audio_spec.freq);
-
-    printf("About to convert wav\n");
-    audio_cvt.buf = malloc(audio_len * audio_cvt.len_mult);
-    audio_cvt.len = audio_len;
-    memcpy(audio_cvt.buf, audio_buf, audio_len);
-    SDL_ConvertAudio(&audio_cvt);
-    printf("Converted wav\n");
-
-    free(audio_buf);
-    audio_buf = audio_cvt.buf;
-    audio_pos = audio_buf;
-    audio_len = audio_cvt.len_cvt;
-
-    cfg_forward = kiss_fft_alloc(NUM_SAMPLES_PER_FILL, 0, NULL, NULL);
-    cfg_inverse = kiss_fft_alloc(NUM_SAMPLES_PER_FILL, 1, NULL, NULL);
-
-    // This will store the entire audio file
-    int num_audio_samples = audio_len / sizeof(float);
-    // 0-pad up to the end
-    int padded_len = ((num_audio_samples - 1) / NUM_SAMPLES_PER_FILL) * NUM_SAMPLES_PER_FILL;
-    audio_kiss_buf = malloc(sizeof(kiss_fft_cpx) * padded_len);
-    memset(audio_kiss_buf, 0, padded_len);
-    total_samples = padded_len;
-
-    const int FFT_SIZE = sizeof(kiss_fft_cpx) * NUM_SAMPLES_PER_FILL;
-
-    audio_kiss_freq = malloc(FFT_SIZE);
-    audio_kiss_freq_l = malloc(FFT_SIZE);
-    audio_kiss_freq_r = malloc(FFT_SIZE);
-    audio_kiss_time_l = malloc(FFT_SIZE);
-    audio_kiss_time_r = malloc(FFT_SIZE);
-
-    memset(audio_kiss_freq, 0, FFT_SIZE);
-    memset(audio_kiss_freq_l, 0, FFT_SIZE);
-    memset(audio_kiss_freq_r, 0, FFT_SIZE);
-    memset(audio_kiss_time_l, 0, FFT_SIZE);
-    memset(audio_kiss_time_r, 0, FFT_SIZE);
-
-    for (int i = 0; (i * SAMPLE_SIZE) < audio_len; i++) {
-        int idx = i;
-        audio_kiss_buf[idx].r = ((float*)audio_buf)[i];
-        audio_kiss_buf[idx].i = 0;
+    // Use mono, the audio will be stereo when the HRTFs are applied. Only
+    // the first ring of a stream is read before playback starts.
+    int file_samples;
+    if (wav_map_open(&file_map, audio_file, obtained_audio_spec.freq) == 0) {
+        printf("Wav Spec, mapped:\n");
+        print_audio_spec(&file_map.spec);
+        file_samples = file_map.num_frames;
+    } else if (wav_stream_open(&file_stream, audio_file, obtained_audio_spec.freq,
+                               STREAM_RING_SAMPLES, true) == 0) {
+        printf("Wav Spec, streamed:\n");
+        print_audio_spec(&file_stream.spec);
+        file_samples = file_stream.num_samples;
+    } else {
+        printf("Could not load audio file: %s", audio_file);
+        SDL_Quit();
+        return 1;
     }
-    int limit = 72;
-    if(!subject) {
-        limit = 37;
+
+    // Loaded once per subject and sample rate, later plays come from memory
+    hrtf_set* hrtfs = hrtf_cache_get(subject ? HRTF_DATABASE_CIPIC : HRTF_DATABASE_MIT, subject,
+                           obtained_audio_spec.freq,
+                           ambisonics_order > 0 || vbap_speakers ? 0 : min_phase_taps);
+    if (!hrtfs) {
+        SDL_Quit();
+        return 1;
     }
 
-    for (int azimuth = 0; azimuth < limit; azimuth++) {
-        char filename[100];
-        if(!subject){
-            sprintf(filename, HRTF_FILE_FORMAT_MIT, 0, 0, azimuth * 5);
-            printf("Loading: %s\n", filename, 0, 0, azimuth * 5);
-        } else {
-            sprintf(filename, HRTF_FILE_FORMAT_CIPIC, subject, 0, azimuth * 5);
-            printf("Loading: %s\n", filename, subject, 0, azimuth * 5);
+    // Convolve in blocks of whatever the device asks for per callback where
+    // the convolver allows it. The HRIR length of the selected database only
+    // sets the number of partitions.
+    int block_size = obtained_audio_spec.samples;
+    if (block_size < CONVOLVER_MIN_BLOCK || block_size > CONVOLVER_MAX_BLOCK) {
+        block_size = NUM_SAMPLES_PER_FILL;
+    }
+    int hrir_len = hrtf_interp_hrir_len(hrtfs);
+    if (hrtfs->min_phase_len > 0) {
+        int longest = hrtfs->min_phase_len + (int)ceilf(HRTF_MAX_ITD * obtained_audio_spec.freq) +
+                      HRTF_INTERP_DELAY_TAPS;
+        if (longest > hrir_len) {
+            hrir_len = longest;
         }
+    }
 
-        SDL_AudioSpec audiofile_spec;
-        Uint8* hrtf_buf;
-        Uint32 hrtf_len;
+    render_mode active_mode = convolution_mode;
+    if (active_mode == RENDER_MODE_AUTO) {
+        active_mode = render_pick_mode(block_size, hrir_len);
+    }
 
-        if (!SDL_LoadWAV(filename, &audiofile_spec, &hrtf_buf, &hrtf_len)) {
-            printf("Could not load hrtf file (%s): %s\n", filename, SDL_GetError());
-            SDL_Quit();
+    // The FFT partitions only cover the taps after the direct-form head.
+    // Hybrid blocks are independent of the callback.
+    int head_len = 0;
+    if (active_mode == RENDER_MODE_HYBRID) {
+        block_size = HYBRID_BLOCK_SIZE;
+        head_len = HYBRID_BLOCK_SIZE;
+    } else if (active_mode == RENDER_MODE_DIRECT) {
+        head_len = hrir_len;
+    }
+    if (conv.block_size != block_size ||
+            conv.num_partitions != convolver_num_partitions(block_size, hrir_len - head_len)) {
+        convolver_free(&conv);
+        if (convolver_init(&conv, block_size, hrir_len - head_len) < 0) {
+            printf("Failed to allocate convolver\n");
             return 1;
         }
+    }
+    printf("Convolver: %s, %d samples per block, %d-point FFT, %d partitions, "
+           "%s FIR, %s spectra, %s FFT\n",
+           active_mode == RENDER_MODE_DIRECT ? "direct" :
+           active_mode == RENDER_MODE_HYBRID ? "hybrid" : "partitioned",
+           conv.block_size, conv.fft_size, conv.num_partitions, fir_kernel_name(),
+           spectrum_kernel_name(), fft_batch_name());
+
+    mixer_free(&mix);
+    render_free(&graph);
+    ambisonics_decoder_free(&decoder);
+    vbap_layout_free(&speaker_layout);
+    if (render_init(&graph, &conv, active_mode, hrir_len) < 0 ||
+            render_set_pool(&graph, &render_pool) < 0) {
+        printf("Failed to allocate render graph\n");
+        return 1;
+    }
 
-        SDL_BuildAudioCVT(&hrtf_audio_cvt,
-                          audiofile_spec.format, audiofile_spec.channels, audiofile_spec.freq,
-                          AUDIO_F32LSB, 2, audiofile_spec.freq);
+    // Partitioned blocks must be whole, so a device size the convolver does
+    // not take is rendered in whole blocks, and the render thread's ring
+    // holds what the callback has not taken yet. The FIR head takes any.
+    int render_frames = obtained_audio_spec.samples;
+    if (graph.head_len == 0) {
+        render_frames = (render_frames + conv.block_size - 1) / conv.block_size * conv.block_size;
+    }
 
-        hrtf_audio_cvt.buf = malloc(hrtf_len* hrtf_audio_cvt.len_mult);
-        hrtf_audio_cvt.len = hrtf_len;
-        memcpy(hrtf_audio_cvt.buf, hrtf_buf, hrtf_len);
-        SDL_ConvertAudio(&hrtf_audio_cvt);
+    // Spectra for this layout are computed on first use and kept. Minimum-
+    // phase filters only get theirs once their delay is back in. The
+    // Ambisonics bus has filters of its own.
+    if (ambisonics_order == 0 && hrtfs->min_phase_len == 0 &&
+            hrtf_cache_select(hrtfs, &conv, graph.head_len) < 0) {
+        printf("Failed to allocate HRTF spectra\n");
+        return 1;
+    }
 
-        init_hrtf_data(&hrtfs[azimuth], (float*)hrtf_audio_cvt.buf,
-                       hrtf_len / SAMPLE_SIZE, azimuth * AZIMUTH_INCREMENT_DEGREES, 0);
+    // Only a filter per voice needs the loader
+    if (ambisonics_order > 0) {
+        if (ambisonics_decoder_init(&decoder, hrtfs, ambisonics_order, &conv,
+                                    graph.head_len) < 0 ||
+                mixer_init_ambisonics(&mix, &graph, NUM_VOICES, render_frames, &decoder) < 0) {
+            printf("Failed to set up an order %d Ambisonics bus\n", ambisonics_order);
+            return 1;
+        }
+        printf("Ambisonics: order %d, %d channels, %s bus kernel\n", decoder.order,
+               decoder.num_channels, ambisonics_kernel_name());
+    } else if (vbap_speakers) {
+        float directions[2 * VBAP_MAX_SPEAKERS];
+        int count = vbap_layout_directions(vbap_speakers, directions);
+        if (vbap_layout_init(&speaker_layout, hrtfs, directions, count) < 0 ||
+                mixer_init_vbap(&mix, &graph, NUM_VOICES, render_frames, &speaker_layout) < 0) {
+            printf("Failed to set up virtual speakers %s\n", vbap_speakers);
+            return 1;
+        }
+        printf("Virtual speakers: %s, %d speakers, %s bus kernel\n", vbap_speakers,
+               speaker_layout.num_speakers, ambisonics_kernel_name());
+    } else {
+        if (mixer_init(&mix, &graph, NUM_VOICES, render_frames) < 0) {
+            printf("Failed to allocate render graph\n");
+            return 1;
+        }
+        if (hrtf_loader_init(&loader, hrtfs, &conv, graph.head_len, render_max_hrir_len(&graph),
+                             mixer_interp_entries(&graph, NUM_VOICES, render_frames),
+                             HRTF_INTERP_RESOLUTION) < 0) {
+            printf("Failed to start HRTF loader\n");
+            return 1;
+        }
+    }
 
-        free(hrtf_buf);
+    total_samples = ((file_samples + conv.block_size - 1) / conv.block_size) * conv.block_size;
+    loop_sample = 0;
+
+    // Nothing renders yet, nothing else touches the mixer
+    trajectory path;
+    set_path(&path, start, finish, userC == 1, AZIMUTH_SPEEDS[jumpC], obtained_audio_spec.freq);
+    if (file_map.base) {
+        file_voice = mixer_play_map(&mix, &file_map, true, 1.0f, &path);
+        printf("Mapped audio file, %s conversion kernel\n", wav_map_kernel_name());
+    } else {
+        file_voice = mixer_play_stream(&mix, &file_stream, 1.0f, &path);
     }
+
+    // From here on the mixer belongs to the render thread. It fills the
+    // ring while the device is still paused.
+    if (render_thread_start(&renderer, render_audio, NULL, render_frames, render_ahead) < 0) {
+        printf("Failed to start render thread\n");
+        return 1;
+    }
+    printf("Rendering %d blocks ahead\n", render_ahead);
     return audio_device;
 }
 
@@ -609,6 +619,7 @@ void GUI(int begin, int end, int sound, int choice, int jump, SDL_AudioDeviceID
             button_process_event(&right_button, &ev);
             if( var == 5 ){
                 if (left_button.pressed || right_button.pressed || backleft_button.pressed ||back_button.pressed || backright_button.pressed){
+                    int azimuth = SDL_AtomicGet(&heard_azimuth);
                     // stop the audio when button is pressed
                     if(left_button.pressed){
                         printf("Left Button Pressed! \n");
@@ -730,6 +741,7 @@ void GUI(int begin, int end, int sound, int choice, int jump, SDL_AudioDeviceID
                         case SDLK_SPACE:    // press space to restart the whole process
                             start = 0;
                             finish = 360;
+                            send_param(PARAM_PATH, start, finish, userC == 1);
                             break;
                         case SDLK_RETURN:
                             temp = 100*(str[0]- '0')+ 10*(str[1] - '0')+ (str[2] - '0');
@@ -751,6 +763,7 @@ void GUI(int begin, int end, int sound, int choice, int jump, SDL_AudioDeviceID
                                     start = temp;
                                 }
                             }
+                            send_param(PARAM_PATH, start, finish, userC == 1);
                             memset(str, 0, sizeof str);
                             break;
                         case SDLK_ESCAPE:
@@ -799,7 +812,10 @@ void GUI(int begin, int end, int sound, int choice, int jump, SDL_AudioDeviceID
                         break;
                     }
                 } else if(var == 5){   // testing page (WIP)
-                    testMode = true;
+                    if (!testMode) {
+                        testMode = true;
+                        send_param(PARAM_QUIET, 1, 0, 0);
+                    }
                     switch (ev.key.keysym.sym)
                     {
                     case SDLK_RETURN:
@@ -866,6 +882,9 @@ void GUI(int begin, int end, int sound, int choice, int jump, SDL_AudioDeviceID
                             printf("%d\n", temp);
                             strcpy(endA, str);
                             subject = temp;
+                            // While playing, swap the subject in without stopping
+                            hrtf_loader_request(&loader, subject ? HRTF_DATABASE_CIPIC :
+                                                HRTF_DATABASE_MIT, subject);
                             memset(str, 0, sizeof str);
                             break;
                         case SDLK_ESCAPE:
@@ -954,6 +973,7 @@ void GUI(int begin, int end, int sound, int choice, int jump, SDL_AudioDeviceID
                         memset(str, 0, sizeof str);
                         break;
                     }
+                    send_param(PARAM_SPEED, AZIMUTH_SPEEDS[jumpC], 0, 0);
                 }
                 
                 break;
@@ -972,6 +992,75 @@ void GUI(int begin, int end, int sound, int choice, int jump, SDL_AudioDeviceID
 //Uint8* audio_buf, Uint32 audio_len, SDL_AudioSpec* file_audio_spec, Uint8* audio_pos
 
 int main(int argc, char* argv[]) {
+    bool bench = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--hybrid") == 0) {
+            convolution_mode = RENDER_MODE_HYBRID;
+        } else if (strcmp(argv[i], "--partitioned") == 0) {
+            convolution_mode = RENDER_MODE_PARTITIONED;
+        } else if (strcmp(argv[i], "--direct") == 0) {
+            convolution_mode = RENDER_MODE_DIRECT;
+        } else if (strcmp(argv[i], "--taps") == 0 && i + 1 < argc) {
+            min_phase_taps = atoi(argv[++i]);
+            if (min_phase_taps < 0) {
+                printf("--taps takes 0 or more taps\n");
+                min_phase_taps = 128;
+            }
+        } else if (strcmp(argv[i], "--ambisonics") == 0 && i + 1 < argc) {
+            ambisonics_order = atoi(argv[++i]);
+            vbap_speakers = NULL;
+        } else if (strcmp(argv[i], "--vbap") == 0 && i + 1 < argc) {
+            float directions[2 * VBAP_MAX_SPEAKERS];
+            if (vbap_layout_directions(argv[++i], directions) < 0) {
+                printf("Unknown speaker layout %s\n", argv[i]);
+            } else {
+                vbap_speakers = argv[i];
+                ambisonics_order = 0;
+            }
+        } else if (strcmp(argv[i], "--ahead") == 0 && i + 1 < argc) {
+            render_ahead = atoi(argv[++i]);
+            if (render_ahead < 1 || render_ahead > RENDER_THREAD_MAX_DEPTH) {
+                printf("--ahead takes 1 to %d blocks\n", RENDER_THREAD_MAX_DEPTH);
+                render_ahead = 2;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            render_threads = atoi(argv[++i]);
+            if (render_threads < 1 || render_threads > TASK_POOL_MAX_THREADS) {
+                printf("--threads takes 1 to %d threads\n", TASK_POOL_MAX_THREADS);
+                render_threads = 1;
+            }
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench = true;
+        }
+    }
+
+    param_queue_init(&params);
+
+    if (hrtf_cache_open_database(HRTF_DATABASE_FILE) == 0) {
+        printf("Using HRTF database %s\n", HRTF_DATABASE_FILE);
+    }
+
+    if (bench) {
+        spectrum_init();
+        spectrum_benchmark();
+
+        // The subject played by default, with the same --taps, and its
+        // measured HRIRs for the Ambisonics decoders
+        hrtf_set* set = hrtf_cache_get(HRTF_DATABASE_MIT, 0, SAMPLE_RATE, min_phase_taps);
+        hrtf_set* measured = hrtf_cache_get(HRTF_DATABASE_MIT, 0, SAMPLE_RATE, 0);
+        if (set && measured) {
+            mixer_benchmark(set, measured);
+        }
+        hrtf_cache_free();
+        return 0;
+    }
+
+    if (task_pool_init(&render_pool, render_threads, true) < 0) {
+        printf("Failed to start %d render threads\n", render_threads);
+        task_pool_init(&render_pool, 1, false);
+    }
+    printf("Rendering on %d threads\n", render_pool.num_threads);
+
     int begin = 0,
         end = 360, 
         sound = 0,
@@ -983,9 +1072,19 @@ int main(int argc, char* argv[]) {
     
     // Cleanup
     SDL_CloseAudio();
-    for (int i = 0; i < AZIMUTH_CNT; i++) {
-        free_hrtf_data(&hrtfs[i]);
+    if (current_device) {
+        SDL_CloseAudioDevice(current_device);
     }
+    render_thread_stop(&renderer);
+    hrtf_loader_free(&loader);
+    mixer_free(&mix);
+    render_free(&graph);
+    task_pool_free(&render_pool);
+    ambisonics_decoder_free(&decoder);
+    vbap_layout_free(&speaker_layout);
+    hrtf_cache_free();
+    wav_map_close(&file_map);
+    wav_stream_close(&file_stream);
     
     SDL_Quit();
 
@@ -14,13 +14,3 @@ const char S_AUDIO_S32SYS[] = "AUDIO_S32SYS";
 const char S_AUDIO_F32LSB[] = "AUDIO_F32LSB";
 const char S_AUDIO_F32MSB[] = "AUDIO_F32MSB";
 const char S_AUDIO_F32SYS[] = "AUDIO_F32SYS";
-
-// Holds hrtf data for a single location
-typedef struct _hrtf_data {
-    int azimuth;
-    int elevation;
-    kiss_fft_cpx* hrir_l;
-    kiss_fft_cpx* hrir_r;
-    kiss_fft_cpx* hrtf_l;
-    kiss_fft_cpx* hrtf_r;
-} hrtf_data;
@@ -0,0 +1,414 @@
+// HRTF set cache
+// See hrtf_cache.h
+
+#include "hrtf_cache.h"
+#include "min_phase.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char HRTF_FILE_FORMAT_MIT[] = "mit/elev%d/H%de%03da.wav";
+const char HRTF_FILE_FORMAT_CIPIC[] = "cipic/subject%03d/e%da%03d.wav";
+
+typedef struct _hrtf_ring_layout {
+    int elevation;
+    int num_azimuths;
+} hrtf_ring_layout;
+
+// KEMAR's full-circle counts per elevation, only 0 ... 180 is on disk
+static const hrtf_ring_layout HRTF_RINGS_MIT[] = {
+    { -40, 56 }, { -30, 60 }, { -20, 72 }, { -10, 72 }, { 0, 72 }, { 10, 72 }, { 20, 72 },
+    { 30, 60 }, { 40, 56 }, { 50, 45 }, { 60, 36 }, { 70, 24 }, { 80, 12 }, { 90, 1 },
+};
+static const hrtf_ring_layout HRTF_RINGS_CIPIC[] = {
+    { 0, 72 },
+};
+
+static hrtf_set* hrtf_sets = NULL;
+static hrtf_db hrtf_db_file;
+
+int hrtf_cache_open_database(const char* path) {
+    hrtf_db_close(&hrtf_db_file);
+    return hrtf_db_open(&hrtf_db_file, path);
+}
+
+// Azimuth of the i-th position of a ring, rounded to whole degrees like
+// the file names
+static int hrtf_ring_azimuth(const hrtf_ring* ring, int i) {
+    return (i * 360 + ring->num_azimuths / 2) / ring->num_azimuths;
+}
+
+// Fills in the ring table and num_positions
+static void init_hrtf_rings(hrtf_set* set) {
+    const hrtf_ring_layout* layout = HRTF_RINGS_CIPIC;
+    int num_rings = sizeof(HRTF_RINGS_CIPIC) / sizeof(HRTF_RINGS_CIPIC[0]);
+    set->mirrored = false;
+    if (set->database == HRTF_DATABASE_MIT) {
+        layout = HRTF_RINGS_MIT;
+        num_rings = sizeof(HRTF_RINGS_MIT) / sizeof(HRTF_RINGS_MIT[0]);
+        set->mirrored = true;
+    }
+
+    set->num_rings = num_rings;
+    set->min_elevation = layout[0].elevation;
+    set->elevation_step = num_rings > 1 ? layout[1].elevation - layout[0].elevation : 1;
+    set->num_positions = 0;
+    for (int r = 0; r < num_rings; r++) {
+        hrtf_ring* ring = &set->rings[r];
+        ring->elevation = layout[r].elevation;
+        ring->num_azimuths = layout[r].num_azimuths;
+        ring->num_stored = set->mirrored ? ring->num_azimuths / 2 + 1 : ring->num_azimuths;
+        ring->first = set->num_positions;
+        set->num_positions += ring->num_stored;
+    }
+}
+
+int hrtf_set_lookup(const hrtf_set* set, int azimuth, int elevation, bool* swap) {
+    int r = 0;
+    if (elevation > set->min_elevation) {
+        r = (elevation - set->min_elevation + set->elevation_step / 2) / set->elevation_step;
+    }
+    if (r >= set->num_rings) {
+        r = set->num_rings - 1;
+    }
+    const hrtf_ring* ring = &set->rings[r];
+
+    azimuth %= 360;
+    if (azimuth < 0) {
+        azimuth += 360;
+    }
+    int i = ((azimuth * ring->num_azimuths + 180) / 360) % ring->num_azimuths;
+
+    // The left side is the right side with the ears swapped
+    *swap = false;
+    if (i >= ring->num_stored) {
+        i = ring->num_azimuths - i;
+        *swap = true;
+    }
+    return ring->first + i;
+}
+
+// Loads one position as float stereo at `sample_rate`. `*hrir` receives
+// `*num_frames` interleaved frames, to be freed by the caller.
+static int load_hrir(const char* filename, int sample_rate, float** hrir, int* num_frames) {
+    SDL_AudioSpec audiofile_spec;
+    SDL_AudioCVT hrtf_audio_cvt;
+    Uint8* hrtf_buf;
+    Uint32 hrtf_len;
+
+    printf("Loading: %s\n", filename);
+    if (!SDL_LoadWAV(filename, &audiofile_spec, &hrtf_buf, &hrtf_len)) {
+        printf("Could not load hrtf file (%s): %s\n", filename, SDL_GetError());
+        return -1;
+    }
+
+    SDL_BuildAudioCVT(&hrtf_audio_cvt,
+                      audiofile_spec.format, audiofile_spec.channels, audiofile_spec.freq,
+                      AUDIO_F32SYS, 2, sample_rate);
+
+    hrtf_audio_cvt.buf = malloc(hrtf_len * hrtf_audio_cvt.len_mult);
+    if (!hrtf_audio_cvt.buf) {
+        SDL_FreeWAV(hrtf_buf);
+        return -1;
+    }
+    hrtf_audio_cvt.len = hrtf_len;
+    memcpy(hrtf_audio_cvt.buf, hrtf_buf, hrtf_len);
+    SDL_FreeWAV(hrtf_buf);
+    SDL_ConvertAudio(&hrtf_audio_cvt);
+
+    *hrir = (float*)hrtf_audio_cvt.buf;
+    *num_frames = hrtf_audio_cvt.len_cvt / (sizeof(float) * 2);
+    return 0;
+}
+
+// Loads every position's WAV file into one block, all left HRIRs then all
+// right ones
+static float* load_hrirs(hrtf_set* set) {
+    float** frames = calloc(set->num_positions, sizeof(float*));
+    int* lengths = calloc(set->num_positions, sizeof(int));
+    float* hrirs = NULL;
+    int loaded = 0;
+    bool failed = false;
+
+    if (!frames || !lengths) {
+        free(frames);
+        free(lengths);
+        return NULL;
+    }
+
+    for (int r = 0; r < set->num_rings && !failed; r++) {
+        const hrtf_ring* ring = &set->rings[r];
+        for (int i = 0; i < ring->num_stored; i++) {
+            int azimuth = hrtf_ring_azimuth(ring, i);
+            char filename[100];
+            if (set->database == HRTF_DATABASE_MIT) {
+                sprintf(filename, HRTF_FILE_FORMAT_MIT, ring->elevation, ring->elevation, azimuth);
+            } else {
+                sprintf(filename, HRTF_FILE_FORMAT_CIPIC, set->subject, ring->elevation, azimuth);
+            }
+            if (load_hrir(filename, set->sample_rate, &frames[loaded], &lengths[loaded]) < 0) {
+                failed = true;
+                break;
+            }
+            if (lengths[loaded] > set->hrir_len) {
+                set->hrir_len = lengths[loaded];
+            }
+            loaded++;
+        }
+    }
+
+    // Deinterleaved, shorter HRIRs zero-padded to the longest
+    if (!failed) {
+        hrirs = calloc(2 * (size_t)set->num_positions * set->hrir_len, sizeof(float));
+    }
+    if (hrirs) {
+        float* left = hrirs;
+        float* right = hrirs + set->num_positions * set->hrir_len;
+        for (int p = 0; p < set->num_positions; p++) {
+            for (int i = 0; i < lengths[p]; i++) {
+                left[p * set->hrir_len + i] = frames[p][i * 2];
+                right[p * set->hrir_len + i] = frames[p][(i * 2) + 1];
+            }
+        }
+    }
+
+    for (int p = 0; p < loaded; p++) {
+        free(frames[p]);
+    }
+    free(frames);
+    free(lengths);
+    return hrirs;
+}
+
+// The database set is only used if it was packed with the same layout
+static bool hrtf_db_matches(const hrtf_set* set, int db_set) {
+    if (db_set < 0 || hrtf_db_file.sets[db_set].num_positions != (Uint32)set->num_positions) {
+        return false;
+    }
+    const hrtf_db_position* positions = hrtf_db_positions(&hrtf_db_file, db_set);
+    for (int r = 0; r < set->num_rings; r++) {
+        const hrtf_ring* ring = &set->rings[r];
+        for (int i = 0; i < ring->num_stored; i++) {
+            const hrtf_db_position* position = &positions[ring->first + i];
+            if (position->azimuth != hrtf_ring_azimuth(ring, i) ||
+                    position->elevation != ring->elevation) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void free_hrtf_set(hrtf_set* set) {
+    if (set->db_set < 0) {
+        free((float*)set->hrirs);
+    }
+    free(set->positions);
+
+    while (set->spectra) {
+        hrtf_spectra* next = set->spectra->next;
+        if (!set->spectra->mapped) {
+            free((float*)set->spectra->data);
+        }
+        free(set->spectra);
+        set->spectra = next;
+    }
+    free(set);
+}
+
+// Points every position at its HRIRs in the set's block
+static void init_hrtf_positions(hrtf_set* set) {
+    for (int r = 0; r < set->num_rings; r++) {
+        const hrtf_ring* ring = &set->rings[r];
+        for (int i = 0; i < ring->num_stored; i++) {
+            int p = ring->first + i;
+            hrtf_data* data = &set->positions[p];
+            data->azimuth = hrtf_ring_azimuth(ring, i);
+            data->elevation = ring->elevation;
+            data->hrir_len = set->hrir_len;
+            data->hrir_l = set->hrirs + p * set->hrir_len;
+            data->hrir_r = data->hrir_l + set->num_positions * set->hrir_len;
+        }
+    }
+}
+
+static hrtf_set* load_hrtf_set(hrtf_database database, int subject, int sample_rate) {
+    hrtf_set* set = calloc(1, sizeof(hrtf_set));
+    if (!set) {
+        return NULL;
+    }
+    set->database = database;
+    set->subject = subject;
+    set->sample_rate = sample_rate;
+    init_hrtf_rings(set);
+
+    set->positions = calloc(set->num_positions, sizeof(hrtf_data));
+    if (!set->positions) {
+        free(set);
+        return NULL;
+    }
+
+    // Straight from the mapping if it is there, nothing to load or copy
+    set->db_set = hrtf_db_find_set(&hrtf_db_file, database, subject, sample_rate);
+    if (!hrtf_db_matches(set, set->db_set)) {
+        set->db_set = -1;
+    }
+    if (set->db_set >= 0) {
+        set->hrir_len = hrtf_db_file.sets[set->db_set].hrir_len;
+        set->hrirs = hrtf_db_hrirs(&hrtf_db_file, set->db_set);
+    } else {
+        set->hrirs = load_hrirs(set);
+    }
+    if (!set->hrirs) {
+        free_hrtf_set(set);
+        return NULL;
+    }
+
+    init_hrtf_positions(set);
+    return set;
+}
+
+// Minimum-phase versions of every HRIR in `measured`, and their onsets
+static hrtf_set* make_min_phase_set(const hrtf_set* measured, int min_phase_len) {
+    hrtf_set* set = calloc(1, sizeof(hrtf_set));
+    min_phase mp;
+    if (!set) {
+        return NULL;
+    }
+    set->database = measured->database;
+    set->subject = measured->subject;
+    set->sample_rate = measured->sample_rate;
+    set->min_phase_len = min_phase_len;
+    set->db_set = -1;
+    init_hrtf_rings(set);
+
+    set->hrir_len = min_phase_len;
+    set->positions = calloc(set->num_positions, sizeof(hrtf_data));
+    set->hrirs = calloc(2 * (size_t)set->num_positions * min_phase_len, sizeof(float));
+    if (!set->positions || !set->hrirs || min_phase_init(&mp, measured->hrir_len) < 0) {
+        free_hrtf_set(set);
+        return NULL;
+    }
+    init_hrtf_positions(set);
+
+    for (int p = 0; p < set->num_positions; p++) {
+        const hrtf_data* source = &measured->positions[p];
+        hrtf_data* data = &set->positions[p];
+        min_phase_make(&mp, source->hrir_l, measured->hrir_len, (float*)data->hrir_l, min_phase_len);
+        min_phase_make(&mp, source->hrir_r, measured->hrir_len, (float*)data->hrir_r, min_phase_len);
+
+        // Only the difference between the ears matters
+        float onset_l = min_phase_onset(source->hrir_l, measured->hrir_len);
+        float onset_r = min_phase_onset(source->hrir_r, measured->hrir_len);
+        float first = onset_l < onset_r ? onset_l : onset_r;
+        data->delay_l = onset_l - first;
+        data->delay_r = onset_r - first;
+        if (data->delay_l > set->max_delay) {
+            set->max_delay = data->delay_l;
+        }
+        if (data->delay_r > set->max_delay) {
+            set->max_delay = data->delay_r;
+        }
+    }
+    min_phase_free(&mp);
+    return set;
+}
+
+hrtf_set* hrtf_cache_get(hrtf_database database, int subject, int sample_rate,
+                         int min_phase_len) {
+    for (hrtf_set* set = hrtf_sets; set; set = set->next) {
+        if (set->database == database && set->subject == subject &&
+                set->sample_rate == sample_rate && set->min_phase_len == min_phase_len) {
+            return set;
+        }
+    }
+
+    hrtf_set* set = NULL;
+    if (min_phase_len > 0) {
+        // Made from the measured set, which stays cached too
+        hrtf_set* measured = hrtf_cache_get(database, subject, sample_rate, 0);
+        if (measured) {
+            set = make_min_phase_set(measured, min_phase_len);
+        }
+    } else {
+        set = load_hrtf_set(database, subject, sample_rate);
+    }
+    if (set) {
+        set->next = hrtf_sets;
+        hrtf_sets = set;
+    }
+    return set;
+}
+
+static hrtf_spectra* make_hrtf_spectra(hrtf_set* set, convolver* conv, int head_len) {
+    hrtf_spectra* spectra = calloc(1, sizeof(hrtf_spectra));
+    if (!spectra) {
+        return NULL;
+    }
+    spectra->fft_size = conv->fft_size;
+    spectra->head_len = head_len;
+    spectra->filter_len = conv->filter_len;
+
+    if (set->db_set >= 0) {
+        spectra->data = hrtf_db_find_spectra(&hrtf_db_file, set->db_set, conv->fft_size,
+                                             head_len, conv->filter_len);
+        if (spectra->data) {
+            spectra->mapped = true;
+            return spectra;
+        }
+    }
+
+    // Direct mode has no partitions, keep the allocation non-empty anyway
+    float* filters = malloc(sizeof(float) * (conv->filter_len * 2 * set->num_positions + 1));
+    spectra->data = filters;
+    if (!filters) {
+        free(spectra);
+        return NULL;
+    }
+
+    // Partitioned and zero-padded to the convolver's FFT size. The first
+    // head_len taps are run directly and left out.
+    for (int i = 0; i < set->num_positions; i++) {
+        hrtf_data* data = &set->positions[i];
+        float* hrtf_l = filters + (i * 2) * conv->filter_len;
+        float* hrtf_r = hrtf_l + conv->filter_len;
+        int tail = data->hrir_len > head_len ? data->hrir_len - head_len : 0;
+
+        convolver_make_hrtf(conv, data->hrir_l + head_len, tail, 1, hrtf_l);
+        convolver_make_hrtf(conv, data->hrir_r + head_len, tail, 1, hrtf_r);
+    }
+    return spectra;
+}
+
+int hrtf_cache_select(hrtf_set* set, convolver* conv, int head_len) {
+    hrtf_spectra* spectra = set->spectra;
+    while (spectra && (spectra->fft_size != conv->fft_size || spectra->head_len != head_len ||
+                       spectra->filter_len != conv->filter_len)) {
+        spectra = spectra->next;
+    }
+
+    if (!spectra) {
+        spectra = make_hrtf_spectra(set, conv, head_len);
+        if (!spectra) {
+            return -1;
+        }
+        spectra->next = set->spectra;
+        set->spectra = spectra;
+    }
+
+    for (int i = 0; i < set->num_positions; i++) {
+        set->positions[i].hrtf_l = spectra->data + (i * 2) * spectra->filter_len;
+        set->positions[i].hrtf_r = set->positions[i].hrtf_l + spectra->filter_len;
+    }
+    return 0;
+}
+
+void hrtf_cache_free(void) {
+    while (hrtf_sets) {
+        hrtf_set* next = hrtf_sets->next;
+        free_hrtf_set(hrtf_sets);
+        hrtf_sets = next;
+    }
+    hrtf_db_close(&hrtf_db_file);
+}
@@ -0,0 +1,112 @@
+// HRTF set cache
+// Loading a subject opens, parses and converts one WAV file per position,
+// and its spectra take one FFT per partition per ear. Both happen once per
+// process: HRIR sets are kept by (database, subject, sample rate and
+// minimum-phase length), and each set keeps its spectra by convolver layout
+// (FFT size, head length and partitions), so replaying or going back to a
+// subject does no file I/O and no FFTs.
+// A set covers every measured ring of elevations. Its HRIRs sit in one
+// contiguous block, all left ears then all right ears, and a ring table
+// maps any (azimuth, elevation) to the nearest position in constant time.
+// Sets can also hold the minimum-phase versions of the measured HRIRs, cut
+// to a given length, with each ear's onset kept as a fractional delay (see
+// min_phase.h). They are made from the measured set at load time and
+// cached next to it.
+// With a binary database open (see hrtf_db.h), sets and any precomputed
+// spectra in it are used in place from the mapping, and only what it lacks
+// is loaded from the WAV files or computed.
+
+#ifndef HRTF_CACHE_H
+#define HRTF_CACHE_H
+
+#include "convolver.h"
+#include "hrtf_db.h"
+
+#include <stdbool.h>
+
+typedef enum {
+    HRTF_DATABASE_MIT,      // KEMAR, 14 rings from -40 to 90, 0 ... 180 mirrored for the left
+    HRTF_DATABASE_CIPIC     // Per subject, horizontal plane 0 ... 355
+} hrtf_database;
+
+#define HRTF_MAX_RINGS 14
+
+// A ring of constant elevation. Mirrored sets only store azimuths 0 ... 180,
+// num_azimuths / 2 + 1 of them, and get the left side by swapping ears.
+typedef struct _hrtf_ring {
+    int elevation;
+    int num_azimuths;       // Positions around the full circle
+    int num_stored;
+    int first;              // Index of the ring's first position
+} hrtf_ring;
+
+// Holds hrtf data for a single location
+typedef struct _hrtf_data {
+    int azimuth;
+    int elevation;
+    int hrir_len;
+    const float* hrir_l;    // Impulse responses, hrir_len samples
+    const float* hrir_r;
+    const float* hrtf_l;    // Partitioned split spectra, conv.filter_len floats
+    const float* hrtf_r;
+    float delay_l;          // Minimum-phase sets: each ear's onset in samples,
+    float delay_r;          // the earlier one at 0
+} hrtf_data;
+
+// Spectra of every position in a set for one convolver layout
+typedef struct _hrtf_spectra {
+    int fft_size;
+    int head_len;           // Taps left out for the direct FIR
+    int filter_len;         // Floats per filter, see convolver.h
+    const float* data;      // Left then right filter of each position
+    bool mapped;            // Points into the database, not owned
+    struct _hrtf_spectra* next;
+} hrtf_spectra;
+
+typedef struct _hrtf_set {
+    hrtf_database database;
+    int subject;
+    int sample_rate;
+    int min_phase_len;      // 0 for the measured HRIRs
+
+    bool mirrored;
+    int num_rings;
+    int min_elevation;      // Of rings[0]
+    int elevation_step;     // Degrees between rings
+    hrtf_ring rings[HRTF_MAX_RINGS];
+
+    int num_positions;
+    int hrir_len;           // Taps per HRIR, shorter ones are zero-padded
+    const float* hrirs;     // num_positions left HRIRs, then the right ones
+    hrtf_data* positions;   // Views into hrirs, and into the spectra last selected
+    int db_set;             // Index in the database, -1 if loaded from WAV files
+    float max_delay;        // Largest delay_l/r of the positions
+
+    hrtf_spectra* spectra;
+    struct _hrtf_set* next;
+} hrtf_set;
+
+// Maps a database written by hrtf_pack for later hrtf_cache_get() calls.
+// Returns 0 on success, -1 if it could not be opened.
+int hrtf_cache_open_database(const char* path);
+
+// Returns the HRIRs of a subject at `sample_rate`, loading them on first
+// use, or NULL if a file could not be loaded. A `min_phase_len` above 0
+// asks for minimum-phase HRIRs of that many taps instead.
+hrtf_set* hrtf_cache_get(hrtf_database database, int subject, int sample_rate,
+                         int min_phase_len);
+
+// Index of the position nearest to (azimuth, elevation), in degrees, and
+// whether its ears must be swapped. Elevations outside the rings clamp to
+// the nearest one.
+int hrtf_set_lookup(const hrtf_set* set, int azimuth, int elevation, bool* swap);
+
+// Points every position's hrtf_l/r at spectra made by `conv` from the taps
+// after `head_len`, computing them on first use. Returns 0 on success, -1
+// if allocation failed.
+int hrtf_cache_select(hrtf_set* set, convolver* conv, int head_len);
+
+// Frees every cached set and closes the database
+void hrtf_cache_free(void);
+
+#endif
@@ -0,0 +1,185 @@
+// Binary HRTF database
+// See hrtf_db.h
+
+#include "hrtf_db.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Maps the whole file, fills in base and size
+static int hrtf_db_map(hrtf_db* db, const char* path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return -1;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        CloseHandle(file);
+        return -1;
+    }
+    const void* base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!base) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return -1;
+    }
+    db->file = file;
+    db->mapping = mapping;
+    db->base = base;
+    db->size = (size_t)size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    db->base = base;
+    db->size = (size_t)st.st_size;
+#endif
+    return 0;
+}
+
+static void hrtf_db_unmap(hrtf_db* db) {
+#ifdef _WIN32
+    UnmapViewOfFile(db->base);
+    CloseHandle(db->mapping);
+    CloseHandle(db->file);
+#else
+    munmap((void*)db->base, db->size);
+#endif
+}
+
+// True if `count` items of `size` bytes at `offset` lie inside the file and
+// the offset is a multiple of `align`
+static bool hrtf_db_range(const hrtf_db* db, Uint64 offset, Uint64 count, Uint64 size,
+                          Uint64 align) {
+    if (offset % align != 0 || offset > db->size) {
+        return false;
+    }
+    return count <= (db->size - offset) / (size ? size : 1);
+}
+
+static bool hrtf_db_check(const hrtf_db* db) {
+    const hrtf_db_header* header = db->header;
+
+    if (header->magic != HRTF_DB_MAGIC || header->version != HRTF_DB_VERSION ||
+            !hrtf_db_range(db, header->sets_offset, header->num_sets, sizeof(hrtf_db_set), 8) ||
+            !hrtf_db_range(db, header->spectra_offset, header->num_spectra,
+                           sizeof(hrtf_db_spectra), 8)) {
+        return false;
+    }
+
+    const hrtf_db_set* sets = (const hrtf_db_set*)(db->base + header->sets_offset);
+    for (Uint32 s = 0; s < header->num_sets; s++) {
+        if (!hrtf_db_range(db, sets[s].positions_offset, sets[s].num_positions,
+                           sizeof(hrtf_db_position), 8)) {
+            return false;
+        }
+        Uint64 floats = 2 * (Uint64)sets[s].num_positions * sets[s].hrir_len;
+        if (!hrtf_db_range(db, sets[s].hrir_offset, floats, sizeof(float), HRTF_DB_ALIGN)) {
+            return false;
+        }
+    }
+
+    const hrtf_db_spectra* spectra = (const hrtf_db_spectra*)(db->base + header->spectra_offset);
+    for (Uint32 i = 0; i < header->num_spectra; i++) {
+        if (spectra[i].set >= header->num_sets) {
+            return false;
+        }
+        Uint64 floats = 2 * (Uint64)spectra[i].filter_len * sets[spectra[i].set].num_positions;
+        if (!hrtf_db_range(db, spectra[i].data_offset, floats, sizeof(float), HRTF_DB_ALIGN)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int hrtf_db_open(hrtf_db* db, const char* path) {
+    memset(db, 0, sizeof(hrtf_db));
+
+    if (hrtf_db_map(db, path) < 0) {
+        return -1;
+    }
+    if (db->size < sizeof(hrtf_db_header)) {
+        hrtf_db_close(db);
+        return -1;
+    }
+    db->header = (const hrtf_db_header*)db->base;
+
+    if (!hrtf_db_check(db)) {
+        printf("Malformed HRTF database: %s\n", path);
+        hrtf_db_close(db);
+        return -1;
+    }
+    db->sets = (const hrtf_db_set*)(db->base + db->header->sets_offset);
+    db->spectra = (const hrtf_db_spectra*)(db->base + db->header->spectra_offset);
+    return 0;
+}
+
+void hrtf_db_close(hrtf_db* db) {
+    if (db->base) {
+        hrtf_db_unmap(db);
+    }
+    memset(db, 0, sizeof(hrtf_db));
+}
+
+int hrtf_db_find_set(const hrtf_db* db, Uint32 database, Uint32 subject, Uint32 sample_rate) {
+    if (!db->base) {
+        return -1;
+    }
+    for (Uint32 s = 0; s < db->header->num_sets; s++) {
+        const hrtf_db_set* set = &db->sets[s];
+        if (set->database == database && set->subject == subject &&
+                set->sample_rate == sample_rate) {
+            return (int)s;
+        }
+    }
+    return -1;
+}
+
+const hrtf_db_position* hrtf_db_positions(const hrtf_db* db, int set) {
+    return (const hrtf_db_position*)(db->base + db->sets[set].positions_offset);
+}
+
+const float* hrtf_db_hrirs(const hrtf_db* db, int set) {
+    return (const float*)(db->base + db->sets[set].hrir_offset);
+}
+
+const float* hrtf_db_find_spectra(const hrtf_db* db, int set, Uint32 fft_size,
+                                  Uint32 head_len, Uint32 filter_len) {
+    for (Uint32 i = 0; i < db->header->num_spectra; i++) {
+        const hrtf_db_spectra* spectra = &db->spectra[i];
+        if (spectra->set == (Uint32)set && spectra->fft_size == fft_size &&
+                spectra->head_len == head_len && spectra->filter_len == filter_len) {
+            return (const float*)(db->base + spectra->data_offset);
+        }
+    }
+    return NULL;
+}
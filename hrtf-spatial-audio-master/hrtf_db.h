@@ -0,0 +1,81 @@
+// Binary HRTF database
+// All subjects and positions in one file, written offline by hrtf_pack and
+// mapped read-only at startup, so loading costs page faults on the data
+// actually touched and processes share the pages. Layout, native endian:
+//     hrtf_db_header
+//     hrtf_db_set[num_sets], each pointing at hrtf_db_position[num_positions]
+//     hrtf_db_spectra[num_spectra], optional precomputed spectra of a set
+//     data: each set's HRIRs as float32 in the hrtf_set layout (all left,
+//           then all right), and spectra in the hrtf_spectra layout, each
+//           block HRTF_DB_ALIGN aligned
+// All offsets are in bytes from the start of the file.
+
+#ifndef HRTF_DB_H
+#define HRTF_DB_H
+
+#include "SDL2/include/SDL.h"
+
+#include <stddef.h>
+
+#define HRTF_DB_MAGIC 0x42445448    // "HTDB"
+#define HRTF_DB_VERSION 2
+#define HRTF_DB_ALIGN 64
+
+typedef struct _hrtf_db_header {
+    Uint32 magic;
+    Uint32 version;
+    Uint32 num_sets;
+    Uint32 num_spectra;
+    Uint64 sets_offset;
+    Uint64 spectra_offset;
+} hrtf_db_header;
+
+typedef struct _hrtf_db_set {
+    Uint32 database;        // hrtf_database
+    Uint32 subject;
+    Uint32 sample_rate;
+    Uint32 num_positions;
+    Uint32 hrir_len;        // Taps per HRIR
+    Uint64 positions_offset;
+    Uint64 hrir_offset;     // 2 * num_positions * hrir_len floats
+} hrtf_db_set;
+
+typedef struct _hrtf_db_position {
+    Sint32 azimuth;
+    Sint32 elevation;
+} hrtf_db_position;
+
+typedef struct _hrtf_db_spectra {
+    Uint32 set;             // Index into the sets
+    Uint32 fft_size;
+    Uint32 head_len;
+    Uint32 filter_len;      // Floats per filter, left and right per position
+    Uint64 data_offset;
+} hrtf_db_spectra;
+
+typedef struct _hrtf_db {
+    const Uint8* base;      // Start of the mapping, NULL when closed
+    size_t size;
+    const hrtf_db_header* header;
+    const hrtf_db_set* sets;
+    const hrtf_db_spectra* spectra;
+    void* file;             // Platform handles
+    void* mapping;
+} hrtf_db;
+
+// Maps `path` read-only and checks every offset in it. Returns 0 on
+// success, -1 if the file is missing, unreadable or malformed.
+int hrtf_db_open(hrtf_db* db, const char* path);
+void hrtf_db_close(hrtf_db* db);
+
+// Returns the set's index, or -1 if the database does not hold it
+int hrtf_db_find_set(const hrtf_db* db, Uint32 database, Uint32 subject, Uint32 sample_rate);
+
+const hrtf_db_position* hrtf_db_positions(const hrtf_db* db, int set);
+const float* hrtf_db_hrirs(const hrtf_db* db, int set);
+
+// Returns precomputed spectra of a set, or NULL if none match
+const float* hrtf_db_find_spectra(const hrtf_db* db, int set, Uint32 fft_size,
+                                  Uint32 head_len, Uint32 filter_len);
+
+#endif
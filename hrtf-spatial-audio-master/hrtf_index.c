@@ -0,0 +1,203 @@
+// Direction index over the measured positions of an HRTF set
+// See hrtf_index.h
+
+#include "hrtf_index.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A ring as seen by one band: its vertices, and whether it collapses to a
+// single corner (the pole, or the only ring of the set)
+typedef struct _band_ring {
+    int first;
+    int count;
+    bool fixed;
+} band_ring;
+
+// Unwrapped azimuth of the k-th vertex, k == count is the first one again
+static float band_ring_azimuth(const hrtf_index* index, const band_ring* ring, int k) {
+    return k == ring->count ? 360.0f : index->vertices[ring->first + k].azimuth;
+}
+
+static void build_band(hrtf_index* index, hrtf_band* band, band_ring lower, band_ring upper) {
+    // A fixed ring never steps, every triangle of the band has it as apex
+    int lower_steps = lower.fixed ? 0 : lower.count;
+    int upper_steps = upper.fixed ? 0 : upper.count;
+    int i = 0, j = 0;
+    bool upper_step = false;
+
+    band->first_rung = index->num_rungs;
+    band->num_triangles = lower_steps + upper_steps;
+    for (;;) {
+        hrtf_rung* rung = &index->rungs[index->num_rungs++];
+        rung->lower = lower.first + i % lower.count;
+        rung->upper = upper.first + j % upper.count;
+        rung->lower_azimuth = band_ring_azimuth(index, &lower, i);
+        rung->upper_azimuth = band_ring_azimuth(index, &upper, j);
+        if (lower.fixed) {
+            rung->lower_azimuth = rung->upper_azimuth;
+        }
+        if (upper.fixed) {
+            rung->upper_azimuth = rung->lower_azimuth;
+        }
+        rung->upper_step = upper_step;
+
+        if (i == lower_steps && j == upper_steps) {
+            break;
+        }
+        // Step whichever ring has the nearer next vertex
+        upper_step = i == lower_steps ||
+                     (j < upper_steps && band_ring_azimuth(index, &upper, j + 1) <
+                                         band_ring_azimuth(index, &lower, i + 1));
+        if (upper_step) {
+            j++;
+        } else {
+            i++;
+        }
+    }
+}
+
+int hrtf_index_init(hrtf_index* index, const hrtf_set* set) {
+    band_ring rings[HRTF_MAX_RINGS];
+
+    memset(index, 0, sizeof(hrtf_index));
+    for (int r = 0; r < set->num_rings; r++) {
+        index->num_vertices += set->rings[r].num_azimuths;
+    }
+    index->vertices = malloc(sizeof(hrtf_vertex) * index->num_vertices);
+    index->rungs = malloc(sizeof(hrtf_rung) * (2 * index->num_vertices + set->num_rings));
+    if (!index->vertices || !index->rungs) {
+        hrtf_index_free(index);
+        return -1;
+    }
+
+    // Every ring around the full circle, the mirrored half from the
+    // measurement on the other side
+    int v = 0;
+    for (int r = 0; r < set->num_rings; r++) {
+        const hrtf_ring* ring = &set->rings[r];
+        rings[r].first = v;
+        rings[r].count = ring->num_azimuths;
+        rings[r].fixed = ring->num_azimuths == 1;
+        for (int i = 0; i < ring->num_azimuths; i++, v++) {
+            hrtf_vertex* vertex = &index->vertices[v];
+            if (i < ring->num_stored) {
+                vertex->position = ring->first + i;
+                vertex->swap = false;
+                vertex->azimuth = (float)set->positions[vertex->position].azimuth;
+            } else {
+                vertex->position = ring->first + ring->num_azimuths - i;
+                vertex->swap = true;
+                vertex->azimuth = 360.0f - set->positions[vertex->position].azimuth;
+            }
+        }
+    }
+
+    index->min_elevation = set->min_elevation;
+    index->elevation_step = set->elevation_step;
+    if (set->num_rings == 1) {
+        // A band from the ring to itself, interpolating along it
+        band_ring apex = rings[0];
+        apex.fixed = true;
+        index->num_bands = 1;
+        index->bands[0].lower_elevation = (float)set->rings[0].elevation;
+        index->bands[0].upper_elevation = (float)set->rings[0].elevation;
+        build_band(index, &index->bands[0], rings[0], apex);
+        return 0;
+    }
+    index->num_bands = set->num_rings - 1;
+    for (int b = 0; b < index->num_bands; b++) {
+        index->bands[b].lower_elevation = (float)set->rings[b].elevation;
+        index->bands[b].upper_elevation = (float)set->rings[b + 1].elevation;
+        build_band(index, &index->bands[b], rings[b], rings[b + 1]);
+    }
+    return 0;
+}
+
+void hrtf_index_free(hrtf_index* index) {
+    free(index->vertices);
+    free(index->rungs);
+    memset(index, 0, sizeof(hrtf_index));
+}
+
+// Where a rung crosses height `t` of its band
+static float rung_azimuth(const hrtf_rung* rung, float t) {
+    return rung->lower_azimuth + t * (rung->upper_azimuth - rung->lower_azimuth);
+}
+
+int hrtf_index_lookup(const hrtf_index* index, float azimuth, float elevation, int hint,
+                      hrtf_weights* weights) {
+    azimuth = fmodf(azimuth, 360.0f);
+    if (azimuth < 0) {
+        azimuth += 360.0f;
+    }
+    if (azimuth >= 360.0f) {
+        azimuth = 0;
+    }
+
+    int b = (int)floorf((elevation - index->min_elevation) / index->elevation_step);
+    if (b < 0) {
+        b = 0;
+    }
+    if (b >= index->num_bands) {
+        b = index->num_bands - 1;
+    }
+    const hrtf_band* band = &index->bands[b];
+    const hrtf_rung* rungs = index->rungs + band->first_rung;
+
+    float t = 0;
+    if (band->upper_elevation > band->lower_elevation) {
+        t = (elevation - band->lower_elevation) / (band->upper_elevation - band->lower_elevation);
+        t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    }
+
+    // Walk from the hint, or from where the triangle would be if they were
+    // evenly spread
+    int k = hint - band->first_rung;
+    if (hint < band->first_rung || k >= band->num_triangles) {
+        k = (int)(azimuth / 360.0f * band->num_triangles);
+        if (k >= band->num_triangles) {
+            k = band->num_triangles - 1;
+        }
+    }
+    while (k > 0 && azimuth < rung_azimuth(&rungs[k], t)) {
+        k--;
+    }
+    while (k < band->num_triangles - 1 && azimuth >= rung_azimuth(&rungs[k + 1], t)) {
+        k++;
+    }
+
+    // The triangle's cross-section at height t runs between its two rungs.
+    // Its single corner takes the height, the other two share the rest by
+    // where the direction falls along the cross-section.
+    const hrtf_rung* left = &rungs[k];
+    const hrtf_rung* right = &rungs[k + 1];
+    float begin = rung_azimuth(left, t);
+    float width = rung_azimuth(right, t) - begin;
+    float f = width > 0 ? (azimuth - begin) / width : 0;
+    f = f < 0 ? 0 : (f > 1 ? 1 : f);
+
+    int corners[3];
+    if (right->upper_step) {
+        corners[0] = left->upper;
+        corners[1] = right->upper;
+        corners[2] = left->lower;
+        weights->weight[0] = t * (1 - f);
+        weights->weight[1] = t * f;
+        weights->weight[2] = 1 - t;
+    } else {
+        corners[0] = left->lower;
+        corners[1] = right->lower;
+        corners[2] = left->upper;
+        weights->weight[0] = (1 - t) * (1 - f);
+        weights->weight[1] = (1 - t) * f;
+        weights->weight[2] = t;
+    }
+    for (int c = 0; c < 3; c++) {
+        weights->position[c] = index->vertices[corners[c]].position;
+        weights->swap[c] = index->vertices[corners[c]].swap;
+    }
+    weights->triangle = band->first_rung + k;
+    return weights->triangle;
+}
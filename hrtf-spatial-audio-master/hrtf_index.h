@@ -0,0 +1,76 @@
+// Direction index over the measured positions of an HRTF set
+// The sphere is triangulated ring by ring. Between two neighbouring rings,
+// the measurements of both are merged in azimuth order and every step adds
+// one triangle, two corners on one ring and one on the other. Consecutive
+// triangles share a "rung", the edge from a lower to an upper corner, and
+// rungs never cross, so the triangles of a band sit side by side in
+// azimuth. A ring of one position (the pole) is the apex of every triangle
+// of its band.
+//
+// Triangles are used in (azimuth, elevation) coordinates, where finding one
+// is a division for the band and a walk along its rungs, starting from the
+// triangle of the previous lookup. Sources that move a little each block
+// find theirs in one or two steps.
+// Directions beyond the outermost rings clamp to them, and a set with a
+// single ring interpolates along it.
+
+#ifndef HRTF_INDEX_H
+#define HRTF_INDEX_H
+
+#include "hrtf_cache.h"
+
+// Corner of the triangulation, one per measurement around the full circle
+typedef struct _hrtf_vertex {
+    float azimuth;          // Degrees, 0 ... 360
+    int position;           // In set->positions
+    bool swap;              // Mirrored measurement, ears swapped
+} hrtf_vertex;
+
+typedef struct _hrtf_rung {
+    int lower;              // Vertices on the lower and upper ring
+    int upper;
+    float lower_azimuth;    // Unwrapped, from 0 at the first rung to 360 at the last
+    float upper_azimuth;
+    bool upper_step;        // The triangle left of this rung advanced the upper ring
+} hrtf_rung;
+
+// Triangles between two rings, triangle k lies between rungs k and k + 1
+typedef struct _hrtf_band {
+    float lower_elevation;
+    float upper_elevation;
+    int first_rung;
+    int num_triangles;
+} hrtf_band;
+
+typedef struct _hrtf_index {
+    int num_vertices;
+    hrtf_vertex* vertices;
+
+    int num_rungs;
+    hrtf_rung* rungs;
+
+    int num_bands;
+    hrtf_band bands[HRTF_MAX_RINGS];
+    int min_elevation;
+    int elevation_step;
+} hrtf_index;
+
+// Enclosing triangle of a direction
+typedef struct _hrtf_weights {
+    int triangle;           // Hint for the next lookup
+    int position[3];        // In set->positions
+    bool swap[3];
+    float weight[3];        // Barycentric, non-negative and summing to 1
+} hrtf_weights;
+
+// Triangulates the positions of `set`. Returns 0 on success, -1 if
+// allocation failed.
+int hrtf_index_init(hrtf_index* index, const hrtf_set* set);
+void hrtf_index_free(hrtf_index* index);
+
+// Fills `weights` for a direction in degrees. `hint` is the triangle of an
+// earlier lookup for the same source, or -1. Returns the triangle found.
+int hrtf_index_lookup(const hrtf_index* index, float azimuth, float elevation, int hint,
+                      hrtf_weights* weights);
+
+#endif
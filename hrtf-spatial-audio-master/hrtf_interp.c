@@ -0,0 +1,242 @@
+// HRTF interpolation
+// See hrtf_interp.h
+
+#include "hrtf_interp.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+int hrtf_interp_hrir_len(const hrtf_set* set) {
+    if (set->min_phase_len == 0) {
+        return set->hrir_len;
+    }
+    return set->hrir_len + (int)ceilf(set->max_delay) + HRTF_INTERP_DELAY_TAPS;
+}
+
+int hrtf_interp_init(hrtf_interp* interp, const hrtf_set* set, convolver* conv, int head_len,
+                     int num_entries, float resolution) {
+    memset(interp, 0, sizeof(hrtf_interp));
+    interp->set = set;
+    interp->conv = conv;
+    interp->head_len = head_len;
+    interp->hrir_len = hrtf_interp_hrir_len(set);
+    interp->resolution = resolution;
+    interp->azimuth_steps = (int)ceilf(360.0f / resolution);
+    interp->elevation_steps = (int)ceilf(90.0f / resolution);
+    interp->num_entries = num_entries;
+
+    if (hrtf_index_init(&interp->index, set) < 0) {
+        return -1;
+    }
+    // At most half the slots are ever in use
+    while ((1 << interp->slot_bits) < 2 * num_entries) {
+        interp->slot_bits++;
+    }
+    int filter_len = conv->filter_len;
+    int entry_len = 2 * (interp->hrir_len + filter_len);
+    interp->entries = malloc(sizeof(hrtf_interp_entry) * num_entries);
+    interp->slots = malloc(sizeof(int) << interp->slot_bits);
+    interp->filters = malloc(sizeof(float) * entry_len * num_entries);
+    interp->aligned = malloc(sizeof(float) * 2 * set->hrir_len);
+    if (!interp->entries || !interp->slots || !interp->filters || !interp->aligned) {
+        hrtf_interp_free(interp);
+        return -1;
+    }
+    memset(interp->slots, -1, sizeof(int) << interp->slot_bits);
+
+    // Empty entries in index order, the first one is used first
+    interp->oldest = 0;
+    interp->newest = num_entries - 1;
+    for (int e = 0; e < num_entries; e++) {
+        hrtf_interp_entry* entry = &interp->entries[e];
+        float* hrir_l = interp->filters + e * entry_len;
+        memset(entry, 0, sizeof(hrtf_interp_entry));
+        entry->key = -1;
+        entry->older = e - 1;
+        entry->newer = e + 1 < num_entries ? e + 1 : -1;
+        entry->data.hrir_len = interp->hrir_len;
+        entry->data.hrir_l = hrir_l;
+        entry->data.hrir_r = hrir_l + interp->hrir_len;
+        entry->data.hrtf_l = hrir_l + 2 * interp->hrir_len;
+        entry->data.hrtf_r = hrir_l + 2 * interp->hrir_len + filter_len;
+    }
+    return 0;
+}
+
+void hrtf_interp_free(hrtf_interp* interp) {
+    hrtf_index_free(&interp->index);
+    free(interp->entries);
+    free(interp->slots);
+    free(interp->filters);
+    free(interp->aligned);
+    memset(interp, 0, sizeof(hrtf_interp));
+}
+
+// out = w * in, or out += w * in
+static void blend(float* out, const float* in, float w, int n, bool first) {
+    if (first) {
+        for (int i = 0; i < n; i++) {
+            out[i] = w * in[i];
+        }
+    } else {
+        for (int i = 0; i < n; i++) {
+            out[i] += w * in[i];
+        }
+    }
+}
+
+// `out` (out_len taps) = `in` delayed by 1 + `delay` samples. The extra
+// sample keeps the Lagrange interpolator centred, on both ears alike.
+static void apply_delay(const float* in, int len, float delay, float* out, int out_len) {
+    int whole = (int)floorf(delay);
+    float x = 1 + (delay - whole);
+    float c[HRTF_INTERP_DELAY_TAPS] = {
+        -(x - 1) * (x - 2) * (x - 3) / 6,
+        x * (x - 2) * (x - 3) / 2,
+        -x * (x - 1) * (x - 3) / 2,
+        x * (x - 1) * (x - 2) / 6,
+    };
+
+    memset(out, 0, sizeof(float) * out_len);
+    for (int j = 0; j < HRTF_INTERP_DELAY_TAPS; j++) {
+        float* o = out + whole + j;
+        for (int i = 0; i < len; i++) {
+            o[i] += c[j] * in[i];
+        }
+    }
+}
+
+static void blend_entry(hrtf_interp* interp, hrtf_interp_entry* entry,
+                        float azimuth, float elevation, int* hint) {
+    const hrtf_set* set = interp->set;
+    hrtf_weights weights;
+    *hint = hrtf_index_lookup(&interp->index, azimuth, elevation, *hint, &weights);
+
+    float* hrir_l = (float*)entry->data.hrir_l;
+    float* hrir_r = (float*)entry->data.hrir_r;
+    float* hrtf_l = (float*)entry->data.hrtf_l;
+    float* hrtf_r = (float*)entry->data.hrtf_r;
+    if (set->min_phase_len == 0) {
+        for (int c = 0; c < 3; c++) {
+            const hrtf_data* corner = &set->positions[weights.position[c]];
+            bool swap = weights.swap[c];
+            float w = weights.weight[c];
+            int filter_len = interp->conv->filter_len;
+
+            blend(hrir_l, swap ? corner->hrir_r : corner->hrir_l, w, set->hrir_len, c == 0);
+            blend(hrir_r, swap ? corner->hrir_l : corner->hrir_r, w, set->hrir_len, c == 0);
+            blend(hrtf_l, swap ? corner->hrtf_r : corner->hrtf_l, w, filter_len, c == 0);
+            blend(hrtf_r, swap ? corner->hrtf_l : corner->hrtf_r, w, filter_len, c == 0);
+        }
+        return;
+    }
+
+    // Aligned filters blend without comb filtering, the delays blend apart
+    float* aligned_l = interp->aligned;
+    float* aligned_r = interp->aligned + set->hrir_len;
+    float delay_l = 0, delay_r = 0;
+    for (int c = 0; c < 3; c++) {
+        const hrtf_data* corner = &set->positions[weights.position[c]];
+        bool swap = weights.swap[c];
+        float w = weights.weight[c];
+
+        blend(aligned_l, swap ? corner->hrir_r : corner->hrir_l, w, set->hrir_len, c == 0);
+        blend(aligned_r, swap ? corner->hrir_l : corner->hrir_r, w, set->hrir_len, c == 0);
+        delay_l += w * (swap ? corner->delay_r : corner->delay_l);
+        delay_r += w * (swap ? corner->delay_l : corner->delay_r);
+    }
+    apply_delay(aligned_l, set->hrir_len, delay_l, hrir_l, interp->hrir_len);
+    apply_delay(aligned_r, set->hrir_len, delay_r, hrir_r, interp->hrir_len);
+
+    int tail = interp->hrir_len > interp->head_len ? interp->hrir_len - interp->head_len : 0;
+    convolver_make_hrtf(interp->conv, hrir_l + interp->head_len, tail, 1, hrtf_l);
+    convolver_make_hrtf(interp->conv, hrir_r + interp->head_len, tail, 1, hrtf_r);
+}
+
+static int home_slot(const hrtf_interp* interp, int key) {
+    return (int)(((Uint32)key * 2654435761u) >> (32 - interp->slot_bits));
+}
+
+// Slot holding `key`, or the empty one it would go in
+static int find_slot(const hrtf_interp* interp, int key) {
+    int mask = (1 << interp->slot_bits) - 1;
+    int slot = home_slot(interp, key);
+    while (interp->slots[slot] >= 0 && interp->entries[interp->slots[slot]].key != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Empties a slot and moves later keys of the same run back into the gap,
+// so no search stops early at it
+static void remove_slot(hrtf_interp* interp, int slot) {
+    int mask = (1 << interp->slot_bits) - 1;
+    interp->slots[slot] = -1;
+    for (int next = (slot + 1) & mask; interp->slots[next] >= 0; next = (next + 1) & mask) {
+        int home = home_slot(interp, interp->entries[interp->slots[next]].key);
+        // Stays put if its home is after the gap, up to where it is
+        if (((next - home) & mask) < ((next - slot) & mask)) {
+            continue;
+        }
+        interp->slots[slot] = interp->slots[next];
+        interp->slots[next] = -1;
+        slot = next;
+    }
+}
+
+// Moves entry e to the newest end of the order of use
+static void make_newest(hrtf_interp* interp, int e) {
+    hrtf_interp_entry* entry = &interp->entries[e];
+    if (interp->newest == e) {
+        return;
+    }
+    interp->entries[entry->newer].older = entry->older;
+    if (entry->older >= 0) {
+        interp->entries[entry->older].newer = entry->newer;
+    } else {
+        interp->oldest = entry->newer;
+    }
+    entry->older = interp->newest;
+    entry->newer = -1;
+    interp->entries[interp->newest].newer = e;
+    interp->newest = e;
+}
+
+const hrtf_data* hrtf_interp_get(hrtf_interp* interp, float azimuth, float elevation,
+                                 int* hint) {
+    int a = (int)floorf(azimuth / interp->resolution + 0.5f) % interp->azimuth_steps;
+    if (a < 0) {
+        a += interp->azimuth_steps;
+    }
+    int e = (int)floorf(elevation / interp->resolution + 0.5f);
+    if (e < -interp->elevation_steps) {
+        e = -interp->elevation_steps;
+    }
+    if (e > interp->elevation_steps) {
+        e = interp->elevation_steps;
+    }
+    int key = (e + interp->elevation_steps) * interp->azimuth_steps + a;
+
+    // A hit, or else the least recently used entry
+    int slot = find_slot(interp, key);
+    int found = interp->slots[slot];
+    if (found >= 0) {
+        make_newest(interp, found);
+        return &interp->entries[found].data;
+    }
+    found = interp->oldest;
+    hrtf_interp_entry* entry = &interp->entries[found];
+    if (entry->key >= 0) {
+        remove_slot(interp, find_slot(interp, entry->key));
+        slot = find_slot(interp, key);
+    }
+    interp->slots[slot] = found;
+    entry->key = key;
+    make_newest(interp, found);
+
+    entry->data.azimuth = (int)lroundf(a * interp->resolution);
+    entry->data.elevation = (int)lroundf(e * interp->resolution);
+    blend_entry(interp, entry, a * interp->resolution, e * interp->resolution, hint);
+    return &entry->data;
+}
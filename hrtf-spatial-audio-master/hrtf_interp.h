@@ -0,0 +1,76 @@
+// HRTF interpolation
+// Filters for directions between the measurements, blended from the three
+// corners of the enclosing triangle (see hrtf_index.h) with their
+// barycentric weights. Mirrored corners are blended with their ears
+// swapped, so results never need it.
+//
+// Measured HRIRs and their spectra are both linear in the taps, so the
+// spectra are blended as they are and no FFT is needed. Minimum-phase sets
+// blend the time-aligned filters and, separately, each ear's delay. The
+// delay then goes back in with a 4-tap Lagrange fractional delay, and the
+// result is transformed once per ear by the convolver. Either way the
+// render path sees one short filter per ear.
+//
+// Directions are quantized to `resolution` degrees and the last
+// `num_entries` blended filters are kept by quantized direction. A source
+// moving slowly asks for the same one for many blocks and only blends when
+// it crosses into the next step. Entries are found through a hash table
+// and kept in order of use, so a lookup costs the same however many
+// sources share the cache.
+
+#ifndef HRTF_INTERP_H
+#define HRTF_INTERP_H
+
+#include "hrtf_index.h"
+
+// Taps of the fractional delay filter
+#define HRTF_INTERP_DELAY_TAPS 4
+
+typedef struct _hrtf_interp_entry {
+    int key;                // Quantized direction, -1 when empty
+    int newer;              // Neighbours in order of use, -1 past the ends
+    int older;
+    hrtf_data data;         // Views into the entry's part of filters
+} hrtf_interp_entry;
+
+typedef struct _hrtf_interp {
+    const hrtf_set* set;
+    hrtf_index index;
+    convolver* conv;
+    int head_len;
+    int hrir_len;           // Taps of the filters made, see hrtf_interp_hrir_len()
+    float resolution;
+    int azimuth_steps;      // Quantized directions per ring, and rings
+    int elevation_steps;    // above and below the horizon
+
+    int num_entries;
+    hrtf_interp_entry* entries;
+    int newest;             // Entry returned last
+    int oldest;             // Entry reused by the next miss
+    int* slots;             // Open-addressed by key, entry indices or -1
+    int slot_bits;          // log2 of the number of slots
+    float* filters;         // Per entry: hrir_l, hrir_r, then hrtf_l, hrtf_r
+    float* aligned;         // Minimum-phase sets: blended filters before the delay
+} hrtf_interp;
+
+// Taps of the filters made for `set`, which the convolver must cover:
+// minimum-phase filters grow by the longest delay
+int hrtf_interp_hrir_len(const hrtf_set* set);
+
+// Filters are made for `conv`, with the first `head_len` taps left out of
+// the spectra. Sets of measured HRIRs must have spectra selected with
+// hrtf_cache_select() for the same layout. A new layout needs a new
+// hrtf_interp. Returns 0 on success, -1 if allocation failed.
+int hrtf_interp_init(hrtf_interp* interp, const hrtf_set* set, convolver* conv, int head_len,
+                     int num_entries, float resolution);
+void hrtf_interp_free(hrtf_interp* interp);
+
+// Filters for a direction in degrees, blended on first use. They stay valid
+// until num_entries other directions have been asked for. `hint` is the
+// caller's triangle hint for hrtf_index_lookup(), -1 at first. Each moving
+// source keeps its own, one shared between sources only walks from the
+// last one's triangle.
+const hrtf_data* hrtf_interp_get(hrtf_interp* interp, float azimuth, float elevation,
+                                 int* hint);
+
+#endif
@@ -0,0 +1,180 @@
+// HRTF loader
+// See hrtf_loader.h
+
+#include "hrtf_loader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// How often the loader checks on retired interps, in ms
+#define HRTF_LOADER_POLL 10
+
+static void free_interp(hrtf_interp* interp) {
+    hrtf_interp_free(interp);
+    free(interp);
+}
+
+// Frees the retired interps two epochs have ended since
+static void reclaim(hrtf_loader* loader) {
+    int epoch = SDL_AtomicGet(&loader->epoch);
+    int kept = 0;
+    for (int i = 0; i < loader->num_retired; i++) {
+        if (epoch - loader->retired_epoch[i] >= 2) {
+            free_interp(loader->retired[i]);
+        } else {
+            loader->retired[kept] = loader->retired[i];
+            loader->retired_epoch[kept] = loader->retired_epoch[i];
+            kept++;
+        }
+    }
+    loader->num_retired = kept;
+}
+
+static void swap_in(hrtf_loader* loader, hrtf_database database, int subject) {
+    hrtf_interp* live = SDL_AtomicGetPtr(&loader->live);
+    hrtf_set* set = hrtf_cache_get(database, subject, loader->sample_rate, loader->min_phase_len);
+    if (!set || set == live->set) {
+        return;
+    }
+    if (hrtf_interp_hrir_len(set) > loader->max_hrir_len) {
+        printf("Subject %d needs %d taps, play again to use it\n", subject,
+               hrtf_interp_hrir_len(set));
+        return;
+    }
+    if (set->min_phase_len == 0 &&
+            hrtf_cache_select(set, &loader->spectra_conv, loader->head_len) < 0) {
+        printf("Failed to allocate HRTF spectra\n");
+        return;
+    }
+
+    hrtf_interp* next = malloc(sizeof(hrtf_interp));
+    if (!next) {
+        printf("Failed to allocate HRTF interpolation\n");
+        return;
+    }
+    if (hrtf_interp_init(next, set, loader->conv, loader->head_len, loader->num_entries,
+                         loader->resolution) < 0) {
+        printf("Failed to allocate HRTF interpolation\n");
+        free(next);
+        return;
+    }
+
+    // The epoch is read after the swap, see hrtf_loader.h
+    hrtf_interp* old = SDL_AtomicSetPtr(&loader->live, next);
+    loader->retired[loader->num_retired] = old;
+    loader->retired_epoch[loader->num_retired] = SDL_AtomicGet(&loader->epoch);
+    loader->num_retired++;
+    printf("Swapped in subject %d\n", subject);
+}
+
+static int loader_thread(void* data) {
+    hrtf_loader* loader = data;
+
+    while (!SDL_AtomicGet(&loader->quit)) {
+        if (loader->num_retired > 0) {
+            SDL_SemWaitTimeout(loader->wake, HRTF_LOADER_POLL);
+        } else {
+            SDL_SemWait(loader->wake);
+        }
+        reclaim(loader);
+
+        // Only the newest request matters. With no room to retire the live
+        // interp, requests stay queued until there is.
+        if (loader->num_retired == HRTF_LOADER_RETIRED) {
+            continue;
+        }
+        param_command command;
+        bool pending = false;
+        while (param_queue_pop(&loader->requests, &command)) {
+            pending = true;
+        }
+        if (pending && !SDL_AtomicGet(&loader->quit)) {
+            swap_in(loader, (hrtf_database)command.type, (int)command.values[0]);
+        }
+    }
+    return 0;
+}
+
+int hrtf_loader_init(hrtf_loader* loader, hrtf_set* set, convolver* conv, int head_len,
+                     int max_hrir_len, int num_entries, float resolution) {
+    memset(loader, 0, sizeof(hrtf_loader));
+    loader->conv = conv;
+    loader->head_len = head_len;
+    loader->max_hrir_len = max_hrir_len;
+    loader->sample_rate = set->sample_rate;
+    loader->min_phase_len = set->min_phase_len;
+    loader->num_entries = num_entries;
+    loader->resolution = resolution;
+    param_queue_init(&loader->requests);
+
+    hrtf_interp* live = malloc(sizeof(hrtf_interp));
+    if (!live) {
+        return -1;
+    }
+    if (hrtf_interp_init(live, set, conv, head_len, num_entries, resolution) < 0) {
+        free(live);
+        return -1;
+    }
+    loader->live = live;
+
+    // Same block size and partitions, so spectra made with it fit `conv`
+    if (convolver_init(&loader->spectra_conv, conv->block_size,
+                       conv->num_partitions * conv->block_size) < 0) {
+        hrtf_loader_free(loader);
+        return -1;
+    }
+
+    loader->wake = SDL_CreateSemaphore(0);
+    if (!loader->wake) {
+        hrtf_loader_free(loader);
+        return -1;
+    }
+    loader->thread = SDL_CreateThread(loader_thread, "hrtf loader", loader);
+    if (!loader->thread) {
+        hrtf_loader_free(loader);
+        return -1;
+    }
+    return 0;
+}
+
+void hrtf_loader_free(hrtf_loader* loader) {
+    if (loader->thread) {
+        SDL_AtomicSet(&loader->quit, 1);
+        SDL_SemPost(loader->wake);
+        SDL_WaitThread(loader->thread, NULL);
+    }
+    if (loader->wake) {
+        SDL_DestroySemaphore(loader->wake);
+    }
+
+    // With the callback stopped every interp can go
+    for (int i = 0; i < loader->num_retired; i++) {
+        free_interp(loader->retired[i]);
+    }
+    if (loader->live) {
+        free_interp(loader->live);
+    }
+    convolver_free(&loader->spectra_conv);
+    memset(loader, 0, sizeof(hrtf_loader));
+}
+
+bool hrtf_loader_request(hrtf_loader* loader, hrtf_database database, int subject) {
+    if (!loader->thread) {
+        return false;
+    }
+    param_command command = { database, { (float)subject, 0, 0 } };
+    if (!param_queue_push(&loader->requests, &command)) {
+        return false;
+    }
+    SDL_SemPost(loader->wake);
+    return true;
+}
+
+hrtf_interp* hrtf_loader_live(hrtf_loader* loader) {
+    return SDL_AtomicGetPtr(&loader->live);
+}
+
+void hrtf_loader_quiescent(hrtf_loader* loader) {
+    SDL_AtomicIncRef(&loader->epoch);
+}
@@ -0,0 +1,80 @@
+// HRTF loader
+// Switches subjects while audio plays. A thread of its own gets the new
+// set from the cache, computes its spectra for the render layout with a
+// convolver of its own, and builds a hrtf_interp over it, all without
+// touching anything the audio callback uses. The new interp is then
+// published with an atomic pointer swap. The callback picks up whichever
+// interp is live at the start of each callback, and render_set_filter()
+// crossfades from the old subject's filter to the new one's over the first
+// block, like any other filter change.
+//
+// The interp swapped out is retired, not freed: the callback may be in the
+// middle of using it, and the render graph holds on to its filters until
+// the crossfade has run. The callback ends an epoch after every callback
+// that leaves the graph holding filters of the interp it picked up and no
+// others (see hrtf_loader_quiescent()). The callback that saw the swap
+// first may have picked up the old interp, but the one after it cannot,
+// so once two epochs have ended since the swap nothing refers to the old
+// interp and the loader frees it. While the device is paused no epochs
+// end and retired interps wait.
+//
+// The cache is not locked, so nothing else may use it while a loader is
+// running.
+
+#ifndef HRTF_LOADER_H
+#define HRTF_LOADER_H
+
+#include "hrtf_interp.h"
+#include "param_queue.h"
+
+// Interps waiting to be freed, further swaps wait until one is
+#define HRTF_LOADER_RETIRED 8
+
+typedef struct _hrtf_loader {
+    // Layout every set is prepared for, from hrtf_loader_init()
+    convolver* conv;        // The callback's, only read for its layout
+    convolver spectra_conv; // Same layout, for the loader's transforms
+    int head_len;
+    int max_hrir_len;       // Longest filter the render graph plays in full
+    int sample_rate;
+    int min_phase_len;
+    int num_entries;
+    float resolution;
+
+    void* live;             // hrtf_interp* the callback plays
+    SDL_atomic_t epoch;     // Epochs ended by the callback
+
+    // Loader thread only
+    hrtf_interp* retired[HRTF_LOADER_RETIRED];
+    int retired_epoch[HRTF_LOADER_RETIRED];
+    int num_retired;
+
+    param_queue requests;   // Subjects to load, from hrtf_loader_request()
+    SDL_atomic_t quit;
+    SDL_sem* wake;
+    SDL_Thread* thread;
+} hrtf_loader;
+
+// Makes `set` live, with interps like hrtf_interp_init() makes (spectra
+// must be selected for measured sets), and starts the loader thread.
+// `max_hrir_len` is the longest filter the render graph holds, longer sets
+// are refused. Call it before the callback starts. Returns 0 on success,
+// -1 if allocation failed or the thread could not be started.
+int hrtf_loader_init(hrtf_loader* loader, hrtf_set* set, convolver* conv, int head_len,
+                     int max_hrir_len, int num_entries, float resolution);
+
+// Stops the thread and frees every interp. The callback must have stopped.
+void hrtf_loader_free(hrtf_loader* loader);
+
+// Asks for a subject to be loaded and swapped in, the latest request wins.
+// Call it from one thread only. Returns false if too many are pending.
+bool hrtf_loader_request(hrtf_loader* loader, hrtf_database database, int subject);
+
+// Callback side: the interp to play this callback
+hrtf_interp* hrtf_loader_live(hrtf_loader* loader);
+
+// Callback side: ends an epoch. Call it at the end of a callback, once the
+// render graph only holds filters of the interp hrtf_loader_live() gave.
+void hrtf_loader_quiescent(hrtf_loader* loader);
+
+#endif
@@ -0,0 +1,236 @@
+// HRTF database packer
+// Offline tool that loads every subject's WAV files through the HRTF cache
+// and writes them into one binary database (see hrtf_db.h), optionally
+// with spectra precomputed for some block sizes.
+//
+// Usage: hrtf_pack [-o hrtf.db] [-r sample_rate] [-b block_size]...
+// Each -b adds partitioned and hybrid spectra at that block size. They are
+// of the measured HRIRs, which only --taps 0 and --vbap play.
+
+#include "SDL2/include/SDL.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hrtf_cache.h"
+#include "hrtf_db.h"
+
+const char DEFAULT_OUTPUT[] = "hrtf.db";
+const char CIPIC_PROBE_FORMAT[] = "cipic/subject%03d/e0a000.wav";
+const int MAX_CIPIC_SUBJECT = 999;
+const int MAX_BLOCK_SIZES = 8;
+
+static Uint64 align_up(Uint64 offset, Uint64 align) {
+    return (offset + align - 1) / align * align;
+}
+
+static int count_spectra(hrtf_set* set) {
+    int count = 0;
+    for (hrtf_spectra* spectra = set->spectra; spectra; spectra = spectra->next) {
+        count++;
+    }
+    return count;
+}
+
+// Pads the file with zeros up to `offset`
+static int write_padding(FILE* file, Uint64 offset) {
+    static const Uint8 zeros[HRTF_DB_ALIGN];
+    long pos = ftell(file);
+    if (pos < 0 || (Uint64)pos > offset) {
+        return -1;
+    }
+    Uint64 n = offset - (Uint64)pos;
+    return fwrite(zeros, 1, n, file) == n ? 0 : -1;
+}
+
+static int write_database(const char* path, hrtf_set** sets, int num_sets) {
+    hrtf_db_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = HRTF_DB_MAGIC;
+    header.version = HRTF_DB_VERSION;
+    header.num_sets = num_sets;
+    for (int s = 0; s < num_sets; s++) {
+        header.num_spectra += count_spectra(sets[s]);
+    }
+
+    hrtf_db_set* db_sets = calloc(num_sets, sizeof(hrtf_db_set));
+    hrtf_db_spectra* db_spectra = calloc(header.num_spectra + 1, sizeof(hrtf_db_spectra));
+    hrtf_db_position** db_positions = calloc(num_sets, sizeof(hrtf_db_position*));
+    if (!db_sets || !db_spectra || !db_positions) {
+        printf("Failed to allocate database tables\n");
+        return -1;
+    }
+
+    // Tables first, then every data block, each aligned
+    Uint64 offset = align_up(sizeof(hrtf_db_header), 8);
+    header.sets_offset = offset;
+    offset = align_up(offset + sizeof(hrtf_db_set) * num_sets, 8);
+    header.spectra_offset = offset;
+    offset = align_up(offset + sizeof(hrtf_db_spectra) * header.num_spectra, 8);
+
+    for (int s = 0; s < num_sets; s++) {
+        db_sets[s].database = sets[s]->database;
+        db_sets[s].subject = sets[s]->subject;
+        db_sets[s].sample_rate = sets[s]->sample_rate;
+        db_sets[s].num_positions = sets[s]->num_positions;
+        db_sets[s].hrir_len = sets[s]->hrir_len;
+        db_sets[s].positions_offset = offset;
+        offset = align_up(offset + sizeof(hrtf_db_position) * sets[s]->num_positions, 8);
+
+        db_positions[s] = calloc(sets[s]->num_positions, sizeof(hrtf_db_position));
+        if (!db_positions[s]) {
+            printf("Failed to allocate database tables\n");
+            return -1;
+        }
+    }
+
+    int n = 0;
+    for (int s = 0; s < num_sets; s++) {
+        for (int p = 0; p < sets[s]->num_positions; p++) {
+            db_positions[s][p].azimuth = sets[s]->positions[p].azimuth;
+            db_positions[s][p].elevation = sets[s]->positions[p].elevation;
+        }
+        offset = align_up(offset, HRTF_DB_ALIGN);
+        db_sets[s].hrir_offset = offset;
+        offset += sizeof(float) * 2 * sets[s]->num_positions * sets[s]->hrir_len;
+
+        for (hrtf_spectra* spectra = sets[s]->spectra; spectra; spectra = spectra->next) {
+            offset = align_up(offset, HRTF_DB_ALIGN);
+            db_spectra[n].set = s;
+            db_spectra[n].fft_size = spectra->fft_size;
+            db_spectra[n].head_len = spectra->head_len;
+            db_spectra[n].filter_len = spectra->filter_len;
+            db_spectra[n].data_offset = offset;
+            offset += sizeof(float) * 2 * spectra->filter_len * sets[s]->num_positions;
+            n++;
+        }
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        printf("Could not open %s for writing\n", path);
+        return -1;
+    }
+
+    // Written in the same order the offsets were laid out
+    int result = 0;
+    result |= fwrite(&header, sizeof(header), 1, file) == 1 ? 0 : -1;
+    result |= write_padding(file, header.sets_offset);
+    result |= fwrite(db_sets, sizeof(hrtf_db_set), num_sets, file) == (size_t)num_sets ? 0 : -1;
+    result |= write_padding(file, header.spectra_offset);
+    result |= fwrite(db_spectra, sizeof(hrtf_db_spectra), header.num_spectra, file) ==
+              header.num_spectra ? 0 : -1;
+    for (int s = 0; s < num_sets; s++) {
+        int count = sets[s]->num_positions;
+        result |= write_padding(file, db_sets[s].positions_offset);
+        result |= fwrite(db_positions[s], sizeof(hrtf_db_position), count, file) ==
+                  (size_t)count ? 0 : -1;
+    }
+
+    n = 0;
+    for (int s = 0; s < num_sets && result == 0; s++) {
+        size_t taps = 2 * (size_t)sets[s]->num_positions * sets[s]->hrir_len;
+        result |= write_padding(file, db_sets[s].hrir_offset);
+        result |= fwrite(sets[s]->hrirs, sizeof(float), taps, file) == taps ? 0 : -1;
+        for (hrtf_spectra* spectra = sets[s]->spectra; spectra; spectra = spectra->next) {
+            size_t floats = 2 * (size_t)spectra->filter_len * sets[s]->num_positions;
+            result |= write_padding(file, db_spectra[n].data_offset);
+            result |= fwrite(spectra->data, sizeof(float), floats, file) == floats ? 0 : -1;
+            n++;
+        }
+    }
+    result |= fclose(file) == 0 ? 0 : -1;
+
+    printf("Wrote %s: %d sets, %u spectra, %.1f MB\n", path, num_sets, header.num_spectra,
+           offset / (1024.0 * 1024.0));
+
+    for (int s = 0; s < num_sets; s++) {
+        free(db_positions[s]);
+    }
+    free(db_positions);
+    free(db_sets);
+    free(db_spectra);
+    return result;
+}
+
+// Adds partitioned and hybrid spectra of every set at `block_size`
+static int add_spectra(hrtf_set** sets, int num_sets, int block_size) {
+    for (int s = 0; s < num_sets; s++) {
+        int heads[] = { 0, block_size };
+        for (int h = 0; h < 2; h++) {
+            int tail = sets[s]->hrir_len - heads[h];
+            if (tail <= 0) {
+                continue;
+            }
+            convolver conv;
+            if (convolver_init(&conv, block_size, tail) < 0 ||
+                    hrtf_cache_select(sets[s], &conv, heads[h]) < 0) {
+                printf("Failed to make spectra for block size %d\n", block_size);
+                convolver_free(&conv);
+                return -1;
+            }
+            convolver_free(&conv);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    const char* output = DEFAULT_OUTPUT;
+    int sample_rate = 44100;
+    int block_sizes[MAX_BLOCK_SIZES];
+    int num_block_sizes = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            sample_rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc &&
+                   num_block_sizes < MAX_BLOCK_SIZES) {
+            block_sizes[num_block_sizes++] = atoi(argv[++i]);
+        } else {
+            printf("Usage: %s [-o hrtf.db] [-r sample_rate] [-b block_size]...\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // MIT plus whichever CIPIC subjects are present
+    hrtf_set** sets = malloc(sizeof(hrtf_set*) * (MAX_CIPIC_SUBJECT + 1));
+    if (!sets) {
+        return 1;
+    }
+    int num_sets = 0;
+    sets[num_sets] = hrtf_cache_get(HRTF_DATABASE_MIT, 0, sample_rate, 0);
+    if (!sets[num_sets]) {
+        return 1;
+    }
+    num_sets++;
+
+    for (int subject = 1; subject <= MAX_CIPIC_SUBJECT; subject++) {
+        char probe[100];
+        sprintf(probe, CIPIC_PROBE_FORMAT, subject);
+        SDL_RWops* rw = SDL_RWFromFile(probe, "rb");
+        if (!rw) {
+            continue;
+        }
+        SDL_RWclose(rw);
+
+        sets[num_sets] = hrtf_cache_get(HRTF_DATABASE_CIPIC, subject, sample_rate, 0);
+        if (!sets[num_sets]) {
+            return 1;
+        }
+        num_sets++;
+    }
+
+    for (int b = 0; b < num_block_sizes; b++) {
+        if (add_spectra(sets, num_sets, block_sizes[b]) < 0) {
+            return 1;
+        }
+    }
+
+    int result = write_database(output, sets, num_sets);
+    hrtf_cache_free();
+    free(sets);
+    return result < 0 ? 1 : 0;
+}
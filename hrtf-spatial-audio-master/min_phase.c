@@ -0,0 +1,125 @@
+// Minimum-phase HRIRs
+// See min_phase.h
+
+#include "min_phase.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Log magnitudes are floored this far below the peak, about -120 dB
+const float MIN_PHASE_FLOOR = 1e-6f;
+
+// Transform length in multiples of the HRIR
+const int MIN_PHASE_OVERSAMPLING = 8;
+
+int min_phase_init(min_phase* mp, int hrir_len) {
+    memset(mp, 0, sizeof(min_phase));
+    mp->fft_size = 2;
+    while (mp->fft_size < hrir_len * MIN_PHASE_OVERSAMPLING) {
+        mp->fft_size *= 2;
+    }
+
+    mp->forward = kiss_fftr_alloc(mp->fft_size, 0, NULL, NULL);
+    mp->inverse = kiss_fftr_alloc(mp->fft_size, 1, NULL, NULL);
+    mp->spectrum = malloc(sizeof(kiss_fft_cpx) * (mp->fft_size / 2 + 1));
+    mp->time = malloc(sizeof(float) * mp->fft_size);
+    if (!mp->forward || !mp->inverse || !mp->spectrum || !mp->time) {
+        min_phase_free(mp);
+        return -1;
+    }
+    return 0;
+}
+
+void min_phase_free(min_phase* mp) {
+    kiss_fftr_free(mp->forward);
+    kiss_fftr_free(mp->inverse);
+    free(mp->spectrum);
+    free(mp->time);
+    memset(mp, 0, sizeof(min_phase));
+}
+
+void min_phase_make(min_phase* mp, const float* hrir, int hrir_len, float* out, int len) {
+    const int n = mp->fft_size;
+    const int num_bins = n / 2 + 1;
+    kiss_fft_cpx* X = mp->spectrum;
+    float* x = mp->time;
+
+    memset(x, 0, sizeof(float) * n);
+    memcpy(x, hrir, sizeof(float) * hrir_len);
+    kiss_fftr(mp->forward, x, X);
+
+    // Real cepstrum, from the log magnitude
+    float peak = 0;
+    for (int k = 0; k < num_bins; k++) {
+        float magnitude = sqrtf(X[k].r * X[k].r + X[k].i * X[k].i);
+        X[k].r = magnitude;
+        if (magnitude > peak) {
+            peak = magnitude;
+        }
+    }
+    float lowest = peak > 0 ? peak * MIN_PHASE_FLOOR : MIN_PHASE_FLOOR;
+    for (int k = 0; k < num_bins; k++) {
+        X[k].r = logf(X[k].r > lowest ? X[k].r : lowest);
+        X[k].i = 0;
+    }
+    kiss_fftri(mp->inverse, X, x);
+
+    // Folding the negative quefrencies onto the positive ones keeps the
+    // magnitude and makes the phase minimum. 1/n undoes the inverse.
+    for (int i = 1; i < n / 2; i++) {
+        x[i] *= 2.0f / n;
+    }
+    x[0] /= n;
+    x[n / 2] /= n;
+    memset(x + n / 2 + 1, 0, sizeof(float) * (n / 2 - 1));
+
+    kiss_fftr(mp->forward, x, X);
+    for (int k = 0; k < num_bins; k++) {
+        float magnitude = expf(X[k].r);
+        float phase = X[k].i;
+        X[k].r = magnitude * cosf(phase);
+        X[k].i = magnitude * sinf(phase);
+    }
+    kiss_fftri(mp->inverse, X, x);
+
+    // Truncated with a raised-cosine fade so the cut does not ring. There
+    // is nothing past the transform, a longer filter is padded with zeros.
+    int taps = len < n ? len : n;
+    int fade = taps / 8;
+    for (int i = 0; i < taps; i++) {
+        float gain = 1.0f / n;
+        if (i >= taps - fade) {
+            gain *= 0.5f + 0.5f * cosf((float)M_PI * (i - (taps - fade) + 1) / (fade + 1));
+        }
+        out[i] = x[i] * gain;
+    }
+    memset(out + taps, 0, sizeof(float) * (len - taps));
+}
+
+float min_phase_onset(const float* hrir, int hrir_len) {
+    float peak = 0;
+    for (int i = 0; i < hrir_len; i++) {
+        if (fabsf(hrir[i]) > peak) {
+            peak = fabsf(hrir[i]);
+        }
+    }
+
+    float threshold = peak * 0.1f;
+    for (int i = 0; i < hrir_len; i++) {
+        float level = fabsf(hrir[i]);
+        if (level >= threshold) {
+            if (i == 0) {
+                return 0;
+            }
+            // Where the line between the two samples crosses the threshold
+            float previous = fabsf(hrir[i - 1]);
+            return i - 1 + (threshold - previous) / (level - previous);
+        }
+    }
+    return 0;
+}
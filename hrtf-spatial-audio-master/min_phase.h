@@ -0,0 +1,39 @@
+// Minimum-phase HRIRs
+// An HRIR is close to a minimum-phase filter delayed by the time sound
+// takes to reach the ear. Splitting the two lets HRIRs of neighbouring
+// directions be blended without comb filtering (their onsets no longer
+// disagree), the delay be interpolated separately, and the filter be cut
+// much shorter, since all of its energy is at the front.
+//
+// The minimum-phase filter is made with the real cepstrum: the log
+// magnitude is transformed back, folded onto positive quefrencies and
+// exponentiated. The transform is several times the HRIR length to keep
+// the cepstrum from aliasing.
+
+#ifndef MIN_PHASE_H
+#define MIN_PHASE_H
+
+#include "kiss_fftr.h"
+
+typedef struct _min_phase {
+    int fft_size;
+    kiss_fftr_cfg forward;
+    kiss_fftr_cfg inverse;
+    kiss_fft_cpx* spectrum;     // fft_size / 2 + 1 bins
+    float* time;                // fft_size samples
+} min_phase;
+
+// Sets up transforms for HRIRs of up to `hrir_len` taps. Returns 0 on
+// success, -1 if allocation failed.
+int min_phase_init(min_phase* mp, int hrir_len);
+void min_phase_free(min_phase* mp);
+
+// Writes the first `len` taps of the minimum-phase version of `hrir`,
+// faded out over the last eighth. Only fft_size taps are computed, any
+// asked for past them are zero.
+void min_phase_make(min_phase* mp, const float* hrir, int hrir_len, float* out, int len);
+
+// Fractional sample at which `hrir` first reaches a tenth of its peak
+float min_phase_onset(const float* hrir, int hrir_len);
+
+#endif
@@ -0,0 +1,607 @@
+// Spatial mixer
+// See mixer.h
+
+#include "mixer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Most voices the benchmark tries
+#define MIXER_BENCH_VOICES 4096
+
+// Allocates the pool, with no render graph nodes yet
+static int init_voices(mixer* mix, render_graph* graph, int num_voices, int max_frames) {
+    memset(mix, 0, sizeof(mixer));
+    mix->graph = graph;
+    mix->max_frames = max_frames;
+
+    mix->voices = calloc(num_voices, sizeof(mixer_voice));
+    mix->inputs = calloc((size_t)num_voices * max_frames, sizeof(float));
+    if (!mix->voices || !mix->inputs) {
+        return -1;
+    }
+    for (int v = 0; v < num_voices; v++) {
+        mixer_voice* voice = &mix->voices[v];
+        voice->source = -1;
+        voice->filter = -1;
+        voice->in = mix->inputs + (size_t)v * max_frames;
+    }
+    mix->num_voices = num_voices;
+    wav_map_init();
+    return 0;
+}
+
+int mixer_init(mixer* mix, render_graph* graph, int num_voices, int max_frames) {
+    if (init_voices(mix, graph, num_voices, max_frames) < 0) {
+        mixer_free(mix);
+        return -1;
+    }
+    for (int v = 0; v < num_voices; v++) {
+        mixer_voice* voice = &mix->voices[v];
+        voice->source = render_add_source(graph);
+        voice->filter = voice->source < 0 ? -1 : render_add_filter(graph, voice->source);
+        if (voice->filter < 0) {
+            mixer_free(mix);
+            return -1;
+        }
+        render_set_active(graph, voice->source, false);
+    }
+    return 0;
+}
+
+// Adds the bus of `num_bus` channels to the graph, a source and filter
+// each
+static int init_bus(mixer* mix, int num_bus) {
+    mix->bus = calloc((size_t)num_bus * mix->max_frames, sizeof(float));
+    if (!mix->bus) {
+        return -1;
+    }
+    for (int c = 0; c < num_bus; c++) {
+        mix->bus_source[c] = render_add_source(mix->graph);
+        mix->bus_filter[c] = mix->bus_source[c] < 0 ? -1 :
+                             render_add_filter(mix->graph, mix->bus_source[c]);
+        if (mix->bus_filter[c] < 0) {
+            return -1;
+        }
+    }
+    mix->num_bus = num_bus;
+    ambisonics_init();
+    return 0;
+}
+
+int mixer_init_ambisonics(mixer* mix, render_graph* graph, int num_voices, int max_frames,
+                          const ambisonics_decoder* decoder) {
+    if (init_voices(mix, graph, num_voices, max_frames) < 0 ||
+            init_bus(mix, decoder->num_channels) < 0) {
+        mixer_free(mix);
+        return -1;
+    }
+    mix->decoder = decoder;
+
+    // The decoder's filters never change
+    for (int c = 0; c < decoder->num_channels; c++) {
+        const float* hrir_l = decoder->hrirs + (size_t)(c * 2) * decoder->hrir_len;
+        const float* hrtf_l = decoder->hrtfs + (size_t)(c * 2) * decoder->filter_len;
+        render_set_filter(graph, mix->bus_filter[c], hrir_l, hrir_l + decoder->hrir_len,
+                          decoder->hrir_len, hrtf_l, hrtf_l + decoder->filter_len);
+    }
+    return 0;
+}
+
+int mixer_init_vbap(mixer* mix, render_graph* graph, int num_voices, int max_frames,
+                    const vbap_layout* layout) {
+    if (init_voices(mix, graph, num_voices, max_frames) < 0 ||
+            init_bus(mix, layout->num_speakers) < 0) {
+        mixer_free(mix);
+        return -1;
+    }
+    mix->layout = layout;
+
+    // Nor do the speakers'
+    for (int s = 0; s < layout->num_speakers; s++) {
+        const vbap_speaker* speaker = &layout->speakers[s];
+        const hrtf_data* data = speaker->data;
+        if (speaker->swap) {
+            render_set_filter(graph, mix->bus_filter[s], data->hrir_r, data->hrir_l,
+                              data->hrir_len, data->hrtf_r, data->hrtf_l);
+        } else {
+            render_set_filter(graph, mix->bus_filter[s], data->hrir_l, data->hrir_r,
+                              data->hrir_len, data->hrtf_l, data->hrtf_r);
+        }
+    }
+    return 0;
+}
+
+void mixer_free(mixer* mix) {
+    free(mix->voices);
+    free(mix->inputs);
+    free(mix->bus);
+    memset(mix, 0, sizeof(mixer));
+}
+
+int mixer_interp_entries(const render_graph* graph, int num_voices, int frames) {
+    // A filter faded from stays in use until the end of its FFT block, and
+    // a direct FIR head until the end of the block after it
+    int blocks = graph->head_len > 0 ? 2 : 1;
+    return num_voices * (1 + blocks * (1 + (graph->conv->block_size - 1) / frames));
+}
+
+int mixer_play(mixer* mix, const float* samples, int num_samples, bool loop, float gain,
+               const trajectory* path) {
+    for (int v = 0; v < mix->num_voices; v++) {
+        mixer_voice* voice = &mix->voices[v];
+        if (voice->state != MIXER_VOICE_FREE) {
+            continue;
+        }
+        voice->state = MIXER_VOICE_PLAYING;
+        voice->samples = samples;
+        voice->num_samples = num_samples;
+        voice->position = 0;
+        voice->loop = loop;
+        voice->stream = NULL;
+        voice->map = NULL;
+        voice->gain = gain;
+        voice->current_gain = gain;
+        voice->path = *path;
+        voice->hint = -1;
+        voice->encoded = false;
+        if (voice->source >= 0) {
+            render_set_active(mix->graph, voice->source, true);
+        }
+        return v;
+    }
+    return -1;
+}
+
+int mixer_play_stream(mixer* mix, wav_stream* stream, float gain, const trajectory* path) {
+    int v = mixer_play(mix, NULL, 0, false, gain, path);
+    if (v >= 0) {
+        mix->voices[v].stream = stream;
+    }
+    return v;
+}
+
+int mixer_play_map(mixer* mix, const wav_map* map, bool loop, float gain,
+                   const trajectory* path) {
+    int v = mixer_play(mix, NULL, map->num_frames, loop, gain, path);
+    if (v >= 0) {
+        mix->voices[v].map = map;
+    }
+    return v;
+}
+
+void mixer_set_gain(mixer* mix, int voice, float gain) {
+    mix->voices[voice].gain = gain;
+}
+
+void mixer_stop(mixer* mix, int voice) {
+    mixer_voice* v = &mix->voices[voice];
+    if (v->state == MIXER_VOICE_PLAYING) {
+        // Past the last input, the HRIR and, in hybrid mode, the FFT block
+        // the output lags by. The bus renders its own tail.
+        v->state = MIXER_VOICE_RELEASING;
+        v->tail = 0;
+        if (mix->num_bus == 0) {
+            v->tail = render_max_hrir_len(mix->graph) + mix->graph->conv->block_size;
+        }
+    }
+}
+
+// Next n samples of a voice, zero past the end, times a gain ramping from
+// where the last call left it to the one set
+static void fill_input(mixer_voice* voice, int n) {
+    float target = voice->state == MIXER_VOICE_PLAYING ? voice->gain : 0;
+    float gain = voice->current_gain;
+    float step = (target - gain) / n;
+    voice->current_gain = target;
+
+    // Mapped samples are converted and ramped in one pass, each run
+    // carrying on the ramp where the last left it
+    int i = 0;
+    if (voice->stream) {
+        i = wav_stream_read(voice->stream, voice->in, n);
+    }
+    while (i < n && voice->position < voice->num_samples) {
+        int run = voice->num_samples - voice->position;
+        if (run > n - i) {
+            run = n - i;
+        }
+        if (voice->map) {
+            wav_map_convert(voice->map, voice->position, run, gain + step * i, step,
+                            voice->in + i);
+        } else {
+            memcpy(voice->in + i, voice->samples + voice->position, sizeof(float) * run);
+        }
+        voice->position += run;
+        i += run;
+        if (voice->position == voice->num_samples && voice->loop) {
+            voice->position = 0;
+        }
+    }
+    memset(voice->in + i, 0, sizeof(float) * (n - i));
+    if (voice->map) {
+        return;
+    }
+
+    if (step == 0) {
+        if (gain != 1) {
+            for (int j = 0; j < i; j++) {
+                voice->in[j] *= gain;
+            }
+        }
+        return;
+    }
+    for (int j = 0; j < i; j++) {
+        voice->in[j] *= gain + step * (j + 1);
+    }
+}
+
+// Adds a voice's input into the bus, its channel gains ramping from the
+// last call's to the ones for (azimuth, elevation)
+static void encode_voice(mixer* mix, mixer_voice* voice, float azimuth, float elevation, int n) {
+    float coeffs[AMBISONICS_MAX_CHANNELS];
+    ambisonics_encode(mix->decoder->order, azimuth, elevation, coeffs);
+    if (!voice->encoded) {
+        memcpy(voice->coeffs, coeffs, sizeof(coeffs));
+        voice->encoded = true;
+    }
+
+    float changes[AMBISONICS_MAX_CHANNELS];
+    for (int c = 0; c < mix->decoder->num_channels; c++) {
+        changes[c] = coeffs[c] - voice->coeffs[c];
+    }
+    ambisonics_add(mix->decoder->num_channels, voice->coeffs, changes, voice->in, mix->bus,
+                   mix->max_frames, n);
+    memcpy(voice->coeffs, coeffs, sizeof(coeffs));
+}
+
+// Adds a voice's input into the bus channels of the speakers it is panned
+// onto, its gains ramping from the last call's
+static void pan_voice(mixer* mix, mixer_voice* voice, float azimuth, float elevation, int n) {
+    const vbap_pan* pan = vbap_lookup(mix->layout, azimuth, elevation);
+    float gains[MIXER_MAX_BUS];
+    memset(gains, 0, sizeof(gains));
+    for (int k = 0; k < 3; k++) {
+        gains[pan->speakers[k]] += pan->gains[k];
+    }
+    if (!voice->encoded) {
+        memcpy(voice->coeffs, gains, sizeof(gains));
+        voice->encoded = true;
+    }
+
+    // Only the speakers it was or is on
+    for (int s = 0; s < mix->num_bus; s++) {
+        if (voice->coeffs[s] == 0 && gains[s] == 0) {
+            continue;
+        }
+        float change = gains[s] - voice->coeffs[s];
+        ambisonics_add(1, &voice->coeffs[s], &change, voice->in,
+                       mix->bus + (size_t)s * mix->max_frames, mix->max_frames, n);
+    }
+    memcpy(voice->coeffs, gains, sizeof(gains));
+}
+
+static void process_chunk(mixer* mix, hrtf_interp* interp, float* out, int n) {
+    if (mix->num_bus > 0) {
+        for (int c = 0; c < mix->num_bus; c++) {
+            memset(mix->bus + (size_t)c * mix->max_frames, 0, sizeof(float) * n);
+        }
+    }
+
+    for (int v = 0; v < mix->num_voices; v++) {
+        mixer_voice* voice = &mix->voices[v];
+        if (voice->state == MIXER_VOICE_FREE) {
+            continue;
+        }
+        bool ended = voice->stream ? wav_stream_finished(voice->stream) :
+                     !voice->loop && voice->position >= voice->num_samples;
+        if (voice->state == MIXER_VOICE_PLAYING && ended) {
+            mixer_stop(mix, v);
+        }
+        // Counted down once the ramp to silence has been rendered
+        if (voice->state == MIXER_VOICE_RELEASING && voice->current_gain == 0) {
+            voice->tail -= n;
+        }
+        fill_input(voice, n);
+
+        // Direction at the first sample, the filter crossfades from the last
+        float azimuth, elevation;
+        trajectory_direction(&voice->path, &azimuth, &elevation);
+        trajectory_advance(&voice->path, n);
+        if (mix->decoder) {
+            encode_voice(mix, voice, azimuth, elevation, n);
+            continue;
+        }
+        if (mix->layout) {
+            pan_voice(mix, voice, azimuth, elevation, n);
+            continue;
+        }
+        const hrtf_data* data = hrtf_interp_get(interp, azimuth, elevation, &voice->hint);
+
+        render_set_input(mix->graph, voice->source, voice->in);
+        render_set_filter(mix->graph, voice->filter, data->hrir_l, data->hrir_r, data->hrir_len,
+                          data->hrtf_l, data->hrtf_r);
+    }
+
+    if (mix->num_bus > 0) {
+        for (int c = 0; c < mix->num_bus; c++) {
+            render_set_input(mix->graph, mix->bus_source[c],
+                             mix->bus + (size_t)c * mix->max_frames);
+        }
+    }
+    render_process(mix->graph, n, out);
+
+    for (int v = 0; v < mix->num_voices; v++) {
+        mixer_voice* voice = &mix->voices[v];
+        if (voice->state == MIXER_VOICE_RELEASING && voice->tail <= 0) {
+            voice->state = MIXER_VOICE_FREE;
+            if (voice->source >= 0) {
+                render_set_active(mix->graph, voice->source, false);
+            }
+        }
+    }
+}
+
+void mixer_process(mixer* mix, hrtf_interp* interp, float* out, int num_frames) {
+    while (num_frames > 0) {
+        int n = num_frames < mix->max_frames ? num_frames : mix->max_frames;
+        process_chunk(mix, interp, out, n);
+        out += n * RENDER_CHANNELS;
+        num_frames -= n;
+    }
+}
+
+// Plays the first `num_voices` voices, looping `noise`, and frees the rest.
+// Then renders for a while and returns whether the slowest calls, but for
+// a few spikes from the rest of the system, kept up with the device.
+static bool keeps_up(mixer* mix, hrtf_interp* interp, const float* noise, int noise_len,
+                     int num_voices, int sample_rate, float* out) {
+    const int WARMUP_CALLS = 16;
+    const int TIMED_CALLS = 64;
+    const int SPIKES = 3;
+
+    for (int v = 0; v < mix->num_voices; v++) {
+        mixer_voice* voice = &mix->voices[v];
+        if (v >= num_voices && voice->state != MIXER_VOICE_FREE) {
+            voice->state = MIXER_VOICE_FREE;
+            if (voice->source >= 0) {
+                render_set_active(mix->graph, voice->source, false);
+            }
+        } else if (v < num_voices && voice->state == MIXER_VOICE_FREE) {
+            // Spread round the head at different speeds, so every voice
+            // moves on to a new filter every so often
+            trajectory path;
+            trajectory_orbit(&path, v * 137.5f, (v % 7) * 10.0f - 30.0f, 10.0f + v % 50,
+                             sample_rate);
+            mixer_play(mix, noise, noise_len, true, 0.05f, &path);
+        }
+    }
+
+    Uint64 slowest[SPIKES + 1];
+    memset(slowest, 0, sizeof(slowest));
+    for (int c = 0; c < WARMUP_CALLS + TIMED_CALLS; c++) {
+        Uint64 begin = SDL_GetPerformanceCounter();
+        mixer_process(mix, interp, out, mix->max_frames);
+        Uint64 ticks = SDL_GetPerformanceCounter() - begin;
+        if (c < WARMUP_CALLS) {
+            continue;
+        }
+        // Slowest first
+        for (int k = 0; k <= SPIKES; k++) {
+            if (ticks > slowest[k]) {
+                Uint64 swap = slowest[k];
+                slowest[k] = ticks;
+                ticks = swap;
+            }
+        }
+    }
+    double period = (double)mix->max_frames / sample_rate;
+    return slowest[SPIKES] < period * SDL_GetPerformanceFrequency();
+}
+
+// Most voices that keep up at `block_size` in `mode`, or -1 if allocation
+// failed. An `order` above 0 mixes them into an Ambisonics bus of that
+// order decoded with filters fitted to `set`, and `speakers` onto that
+// virtual speaker layout of `set`'s positions, which must then be measured.
+// The graph renders on `pool`, if not NULL.
+static int max_voices(hrtf_set* set, int order, const char* speakers, int block_size,
+                      render_mode mode, task_pool* pool, const float* noise, int noise_len,
+                      float* out) {
+    bool bus = order > 0 || speakers;
+    int hrir_len = bus ? set->hrir_len : hrtf_interp_hrir_len(set);
+    convolver conv;
+    render_graph graph;
+    hrtf_interp interp;
+    ambisonics_decoder decoder;
+    vbap_layout layout;
+    mixer mix;
+    memset(&graph, 0, sizeof(graph));
+    memset(&interp, 0, sizeof(interp));
+    memset(&decoder, 0, sizeof(decoder));
+    memset(&layout, 0, sizeof(layout));
+    memset(&mix, 0, sizeof(mix));
+
+    int head_len = (mode == RENDER_MODE_DIRECT) ? hrir_len : 0;
+    if (convolver_init(&conv, block_size, hrir_len - head_len) < 0) {
+        return -1;
+    }
+    bool ready = render_init(&graph, &conv, mode, hrir_len) == 0 &&
+                 render_set_pool(&graph, pool) == 0;
+    if (order > 0) {
+        ready = ready &&
+                ambisonics_decoder_init(&decoder, set, order, &conv, graph.head_len) == 0 &&
+                mixer_init_ambisonics(&mix, &graph, MIXER_BENCH_VOICES, block_size,
+                                      &decoder) == 0;
+    } else if (speakers) {
+        float directions[2 * VBAP_MAX_SPEAKERS];
+        int count = vbap_layout_directions(speakers, directions);
+        ready = ready &&
+                hrtf_cache_select(set, &conv, graph.head_len) == 0 &&
+                vbap_layout_init(&layout, set, directions, count) == 0 &&
+                mixer_init_vbap(&mix, &graph, MIXER_BENCH_VOICES, block_size, &layout) == 0;
+    } else {
+        ready = ready &&
+                mixer_init(&mix, &graph, MIXER_BENCH_VOICES, block_size) == 0 &&
+                (set->min_phase_len > 0 || hrtf_cache_select(set, &conv, graph.head_len) == 0) &&
+                hrtf_interp_init(&interp, set, &conv, graph.head_len,
+                                 mixer_interp_entries(&graph, MIXER_BENCH_VOICES, block_size),
+                                 1.0f) == 0;
+    }
+    hrtf_interp* filters = bus ? NULL : &interp;
+    int good = -1;
+    if (ready) {
+        // Double the voices until they miss, then bisect
+        int bad = MIXER_BENCH_VOICES + 1;
+        good = 0;
+        while (good < MIXER_BENCH_VOICES && bad > MIXER_BENCH_VOICES) {
+            int n = good > 0 ? 2 * good : 1;
+            if (n > MIXER_BENCH_VOICES) {
+                n = MIXER_BENCH_VOICES;
+            }
+            if (keeps_up(&mix, filters, noise, noise_len, n, set->sample_rate, out)) {
+                good = n;
+            } else {
+                bad = n;
+            }
+        }
+        while (bad - good > 1) {
+            int n = (good + bad) / 2;
+            if (keeps_up(&mix, filters, noise, noise_len, n, set->sample_rate, out)) {
+                good = n;
+            } else {
+                bad = n;
+            }
+        }
+    }
+
+    hrtf_interp_free(&interp);
+    ambisonics_decoder_free(&decoder);
+    vbap_layout_free(&layout);
+    mixer_free(&mix);
+    render_free(&graph);
+    convolver_free(&conv);
+    return good;
+}
+
+// Prints max_voices(), or that allocation failed, and returns it
+static int print_max_voices(hrtf_set* set, int order, const char* speakers, int block_size,
+                            render_mode mode, task_pool* pool, const float* noise, int noise_len,
+                            float* out) {
+    int voices = max_voices(set, order, speakers, block_size, mode, pool, noise, noise_len, out);
+    if (voices < 0) {
+        printf("failed to allocate");
+    } else {
+        printf("%s%4d voices", voices == MIXER_BENCH_VOICES ? ">=" : "", voices);
+    }
+    return voices;
+}
+
+void mixer_benchmark(hrtf_set* set, hrtf_set* measured) {
+    const int BLOCK_SIZES[] = { 512, 256, 128 };
+    const int NUM_BLOCK_SIZES = sizeof(BLOCK_SIZES) / sizeof(BLOCK_SIZES[0]);
+
+    // A second of noise for every voice to loop
+    int noise_len = set->sample_rate;
+    float* noise = malloc(sizeof(float) * noise_len);
+    float* out = malloc(sizeof(float) * RENDER_CHANNELS * BLOCK_SIZES[0]);
+    if (!noise || !out) {
+        printf("Failed to allocate benchmark buffers\n");
+        free(noise);
+        free(out);
+        return;
+    }
+    for (int i = 0; i < noise_len; i++) {
+        noise[i] = (float)(rand() % 2001 - 1000) / 1000.0f;
+    }
+
+    printf("Mixer, most voices without missing the device deadline (%d-tap HRTFs, %d Hz):\n",
+           hrtf_interp_hrir_len(set), set->sample_rate);
+    // Shared inverse transforms make partitioned mode scale better than a
+    // single source's timing in render_pick_mode() suggests, so both run
+    for (int b = 0; b < NUM_BLOCK_SIZES; b++) {
+        printf("  %4d samples:", BLOCK_SIZES[b]);
+        for (int direct = 0; direct <= 1; direct++) {
+            render_mode mode = direct ? RENDER_MODE_DIRECT : RENDER_MODE_PARTITIONED;
+            printf("  %s ", direct ? "direct" : "partitioned");
+            print_max_voices(set, 0, NULL, BLOCK_SIZES[b], mode, NULL, noise, noise_len, out);
+        }
+        printf("\n");
+    }
+
+    // The bus only has a few sources to render, so partitioned mode. The
+    // decoder's distance from the HRTFs it was fitted to is the quality
+    // given up for the voices.
+    ambisonics_init();
+    printf("Ambisonic mode, decoded with filters fitted to the %d-tap measured HRTFs, "
+           "%s bus kernel:\n", measured->hrir_len, ambisonics_kernel_name());
+    for (int order = 1; order <= AMBISONICS_MAX_ORDER; order++) {
+        convolver conv;
+        ambisonics_decoder decoder;
+        float error = 0;
+        if (convolver_init(&conv, BLOCK_SIZES[0], measured->hrir_len) == 0) {
+            if (ambisonics_decoder_init(&decoder, measured, order, &conv, 0) == 0) {
+                error = ambisonics_decoder_error(&decoder, measured);
+                ambisonics_decoder_free(&decoder);
+            }
+            convolver_free(&conv);
+        }
+        printf("  order %d, %2d channels, %4.1f dB log-spectral distance:", order,
+               ambisonics_channels(order), error);
+        for (int b = 0; b < NUM_BLOCK_SIZES; b++) {
+            printf("  %d ", BLOCK_SIZES[b]);
+            print_max_voices(measured, order, NULL, BLOCK_SIZES[b], RENDER_MODE_PARTITIONED,
+                             NULL, noise, noise_len, out);
+        }
+        printf("\n");
+    }
+
+    printf("Virtual speaker mode, through the %d-tap measured HRTFs:\n", measured->hrir_len);
+    for (int p = 0; vbap_preset_name(p); p++) {
+        float directions[2 * VBAP_MAX_SPEAKERS];
+        vbap_layout layout;
+        int speakers = 0;
+        if (vbap_layout_init(&layout, measured, directions,
+                             vbap_layout_directions(vbap_preset_name(p), directions)) == 0) {
+            speakers = layout.num_speakers;
+            vbap_layout_free(&layout);
+        }
+        printf("  %-6s %2d speakers:", vbap_preset_name(p), speakers);
+        for (int b = 0; b < NUM_BLOCK_SIZES; b++) {
+            printf("  %d ", BLOCK_SIZES[b]);
+            print_max_voices(measured, 0, vbap_preset_name(p), BLOCK_SIZES[b],
+                             RENDER_MODE_PARTITIONED, NULL, noise, noise_len, out);
+        }
+        printf("\n");
+    }
+
+    // Only the FFT stage is spread over the threads, the voices' own work
+    // stays on the caller's, so this is how far that part scales
+    int num_cores = SDL_GetCPUCount();
+    if (num_cores > TASK_POOL_MAX_THREADS) {
+        num_cores = TASK_POOL_MAX_THREADS;
+    }
+    printf("Partitioned mode on 1 to %d cores, %d samples:\n", num_cores, BLOCK_SIZES[2]);
+    int single = 0;
+    for (int threads = 1; threads <= num_cores; threads++) {
+        task_pool pool;
+        printf("  %2d threads: ", threads);
+        if (task_pool_init(&pool, threads, true) < 0) {
+            printf("failed to start\n");
+            continue;
+        }
+        int voices = print_max_voices(set, 0, NULL, BLOCK_SIZES[2], RENDER_MODE_PARTITIONED,
+                                      &pool, noise, noise_len, out);
+        task_pool_free(&pool);
+        if (threads == 1) {
+            single = voices;
+        }
+        if (single > 0 && voices > 0) {
+            printf(", %.2fx", (double)voices / single);
+        }
+        printf("\n");
+    }
+
+    free(noise);
+    free(out);
+}
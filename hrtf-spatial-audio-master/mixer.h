@@ -0,0 +1,152 @@
+// Spatial mixer
+// Plays any number of sounds at once, each from its own samples, its own
+// wav_stream or a wav_map, with its own gain and its own path, through one
+// render graph. Voices come from a pool made by mixer_init(), one render
+// source and filter each, so voices can be started and stopped from the
+// audio callback without allocating. Voices not playing are inactive in
+// the graph and cost nothing.
+//
+// Each call, every playing voice copies its next samples with its gain
+// into its source's input, converting mapped ones on the way, and gets the
+// filter for its direction from the hrtf_interp. All of them are then
+// rendered by one render_process(), so the ears are still transformed back
+// once however many voices there are.
+// Gain changes ramp over one call. A voice stopped, or past the end of
+// samples that do not loop or of a stream that has finished, ramps down
+// and then plays silence until its filter's tail has run out, before going
+// back to the pool. A stream running dry for a moment plays silence and
+// carries on.
+//
+// The hrtf_interp keeps every voice's filter and the ones they fade from,
+// so it needs more entries than voices, and as many again for the fades:
+// mixer_interp_entries() gives a safe number.
+//
+// In Ambisonic mode (mixer_init_ambisonics()) voices have no nodes of
+// their own. Each call adds every voice into the bus, its channel gains
+// ramping from the last call's direction to this one's, and the bus is
+// rendered by the decoder's fixed filters, so the convolutions cost the
+// same for any number of voices (see ambisonics.h). No hrtf_interp is used.
+// Virtual speaker mode (mixer_init_vbap()) works the same way, with a bus
+// channel per speaker, each voice panned onto at most three of them and
+// the channels rendered by the speakers' HRTFs (see vbap.h).
+
+#ifndef MIXER_H
+#define MIXER_H
+
+#include "ambisonics.h"
+#include "hrtf_interp.h"
+#include "render.h"
+#include "trajectory.h"
+#include "vbap.h"
+#include "wav_map.h"
+#include "wav_stream.h"
+
+// Most channels of any bus mode
+#define MIXER_MAX_BUS AMBISONICS_MAX_CHANNELS
+
+typedef enum {
+    MIXER_VOICE_FREE,
+    MIXER_VOICE_PLAYING,
+    MIXER_VOICE_RELEASING   // Ramping down, then rendering out its tail
+} mixer_voice_state;
+
+typedef struct _mixer_voice {
+    mixer_voice_state state;
+    int source;             // Render graph nodes
+    int filter;
+
+    const float* samples;   // Mono, at the device's sample rate
+    int num_samples;
+    int position;           // Next sample played
+    bool loop;
+    wav_stream* stream;     // Played instead of samples when set
+    const wav_map* map;     // Or this, converted as it is read, num_samples its frames
+
+    float gain;             // Set with mixer_set_gain()
+    float current_gain;     // Reached at the end of the last call
+    int tail;               // Releasing: samples of silence still to render
+
+    trajectory path;        // Advanced by every call, may be changed between
+    int hint;               // Triangle of its last filter blend, see hrtf_interp_get()
+    float* in;              // max_frames samples of input with the gain applied
+
+    // Bus modes: channel gains reached at the end of the last call
+    float coeffs[MIXER_MAX_BUS];
+    bool encoded;           // False until the first call sets coeffs
+} mixer_voice;
+
+typedef struct _mixer {
+    render_graph* graph;
+    int max_frames;         // Frames rendered per render_process() call
+    int num_voices;
+    mixer_voice* voices;
+    float* inputs;          // Every voice's `in`
+
+    // Bus modes only, one of decoder and layout set
+    const ambisonics_decoder* decoder;
+    const vbap_layout* layout;
+    int num_bus;            // Channels, 0 for a filter per voice
+    float* bus;             // max_frames samples per channel
+    int bus_source[MIXER_MAX_BUS];
+    int bus_filter[MIXER_MAX_BUS];
+} mixer;
+
+// Adds `num_voices` sources and filters to `graph` for the pool. Calls to
+// mixer_process() are rendered `max_frames` at a time. Returns 0 on
+// success, -1 if allocation failed or the graph is too small.
+int mixer_init(mixer* mix, render_graph* graph, int num_voices, int max_frames);
+void mixer_free(mixer* mix);
+
+// Like mixer_init(), but the voices are mixed into an Ambisonics bus of
+// the decoder's order, and only the bus is added to `graph`, with a source
+// and filter per channel. The decoder must outlive the mixer.
+int mixer_init_ambisonics(mixer* mix, render_graph* graph, int num_voices, int max_frames,
+                          const ambisonics_decoder* decoder);
+
+// Like mixer_init_ambisonics(), with a bus channel per speaker of `layout`
+// rendered by its position's HRTFs. The spectra selected in the layout's
+// set must fit `graph`. The layout must outlive the mixer.
+int mixer_init_vbap(mixer* mix, render_graph* graph, int num_voices, int max_frames,
+                    const vbap_layout* layout);
+
+// hrtf_interp entries needed for `num_voices` voices rendered in calls of
+// `frames` frames
+int mixer_interp_entries(const render_graph* graph, int num_voices, int frames);
+
+// Starts playing `num_samples` samples along `path`, which is copied.
+// Returns the voice, or -1 if every voice is in use. The samples must stay
+// valid until the voice is free again.
+int mixer_play(mixer* mix, const float* samples, int num_samples, bool loop, float gain,
+               const trajectory* path);
+
+// Like mixer_play(), with samples read from `stream` until it finishes, so
+// it loops if the stream does. The stream must stay open until the voice
+// is free again, and nothing else may read it.
+int mixer_play_stream(mixer* mix, wav_stream* stream, float gain, const trajectory* path);
+
+// Like mixer_play(), with samples read straight from `map`. Any number of
+// voices may play the same map, which must stay open until they are free.
+int mixer_play_map(mixer* mix, const wav_map* map, bool loop, float gain,
+                   const trajectory* path);
+
+void mixer_set_gain(mixer* mix, int voice, float gain);
+
+// Ramps the voice down and frees it once its tail has played
+void mixer_stop(mixer* mix, int voice);
+
+// Renders `num_frames` frames of interleaved stereo into `out`, with
+// filters from `interp`, which may be NULL in the bus modes
+void mixer_process(mixer* mix, hrtf_interp* interp, float* out, int num_frames);
+
+// Finds the most voices `set` can play without missing the device's
+// deadline at 512, 256 and 128 sample blocks, and prints them. A call
+// misses when it takes longer than its block lasts at the set's sample
+// rate; the few slowest calls are let off as spikes from the rest of the
+// system.
+// Then does the same for the Ambisonic mode of each order, with decoders
+// fitted to `measured`, the same subject's measured HRIRs, and prints how
+// far each order's decoder is from them, and for virtual speaker mode with
+// each preset layout of `measured`'s positions.
+void mixer_benchmark(hrtf_set* set, hrtf_set* measured);
+
+#endif
@@ -0,0 +1,40 @@
+// Parameter queue
+// See param_queue.h
+
+#include "param_queue.h"
+
+#include <string.h>
+
+void param_queue_init(param_queue* queue) {
+    memset(queue->commands, 0, sizeof(queue->commands));
+    SDL_AtomicSet(&queue->written, 0);
+    SDL_AtomicSet(&queue->read, 0);
+}
+
+bool param_queue_push(param_queue* queue, const param_command* command) {
+    // The counters run freely and wrap, only their difference matters
+    unsigned written = (unsigned)SDL_AtomicGet(&queue->written);
+    unsigned read = (unsigned)SDL_AtomicGet(&queue->read);
+    if (written - read >= PARAM_QUEUE_SIZE) {
+        return false;
+    }
+
+    queue->commands[written & (PARAM_QUEUE_SIZE - 1)] = *command;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&queue->written, (int)(written + 1));
+    return true;
+}
+
+bool param_queue_pop(param_queue* queue, param_command* command) {
+    unsigned read = (unsigned)SDL_AtomicGet(&queue->read);
+    unsigned written = (unsigned)SDL_AtomicGet(&queue->written);
+    if (read == written) {
+        return false;
+    }
+
+    SDL_MemoryBarrierAcquire();
+    *command = queue->commands[read & (PARAM_QUEUE_SIZE - 1)];
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&queue->read, (int)(read + 1));
+    return true;
+}
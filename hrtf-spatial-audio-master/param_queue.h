@@ -0,0 +1,39 @@
+// Parameter queue
+// Hands control changes from one thread to another without locks: a ring
+// of fixed-size commands with one producer (the GUI) and one consumer (the
+// audio callback). Each side only ever writes its own counter. The producer
+// fills a slot before publishing the new count, and the consumer reads it
+// only after seeing that count, with release and acquire barriers between.
+// The callback drains the queue at the start of a block, so a change never
+// lands halfway through one and never waits on SDL_LockAudioDevice().
+
+#ifndef PARAM_QUEUE_H
+#define PARAM_QUEUE_H
+
+#include "SDL2/include/SDL.h"
+
+#include <stdbool.h>
+
+// Slots in the ring, a power of two
+#define PARAM_QUEUE_SIZE 64
+
+typedef struct _param_command {
+    int type;               // Up to the caller
+    float values[3];
+} param_command;
+
+typedef struct _param_queue {
+    param_command commands[PARAM_QUEUE_SIZE];
+    SDL_atomic_t written;   // Commands pushed so far, only the producer changes it
+    SDL_atomic_t read;      // Commands popped so far, only the consumer changes it
+} param_queue;
+
+void param_queue_init(param_queue* queue);
+
+// Producer side. Returns false, dropping the command, if the queue is full.
+bool param_queue_push(param_queue* queue, const param_command* command);
+
+// Consumer side. Returns false if there is nothing to pop.
+bool param_queue_pop(param_queue* queue, param_command* command);
+
+#endif
@@ -0,0 +1,665 @@
+// Render graph
+// See render.h
+
+#include "render.h"
+#include "fir.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int render_init(render_graph* graph, convolver* conv, render_mode mode, int hrir_len) {
+    memset(graph, 0, sizeof(render_graph));
+    graph->conv = conv;
+    graph->mode = mode;
+    fir_init();
+    if (mode == RENDER_MODE_HYBRID) {
+        graph->head_len = conv->block_size;
+    } else if (mode == RENDER_MODE_DIRECT) {
+        graph->head_len = hrir_len;
+    }
+
+    for (int c = 0; c < RENDER_CHANNELS; c++) {
+        graph->acc[c] = calloc(conv->spectrum_len, sizeof(float));
+        graph->tail[c] = calloc(conv->tail_len, sizeof(float));
+        graph->fft_out[c] = calloc(conv->block_size, sizeof(float));
+        graph->fade_acc[c] = malloc(sizeof(float) * conv->spectrum_len);
+        graph->fade_new[c] = malloc(sizeof(float) * conv->spectrum_len);
+        if (!graph->acc[c] || !graph->tail[c] || !graph->fft_out[c] ||
+                !graph->fade_acc[c] || !graph->fade_new[c]) {
+            render_free(graph);
+            return -1;
+        }
+    }
+    graph->partial = malloc(sizeof(float) * conv->block_size * RENDER_CHANNELS);
+    graph->fade_fir[0] = malloc(sizeof(float) * conv->block_size * RENDER_CHANNELS);
+    graph->fade_fir[1] = malloc(sizeof(float) * conv->block_size * RENDER_CHANNELS);
+    if (!graph->partial || !graph->fade_fir[0] || !graph->fade_fir[1]) {
+        render_free(graph);
+        return -1;
+    }
+    return 0;
+}
+
+void render_free(render_graph* graph) {
+    for (int s = 0; s < graph->num_sources; s++) {
+        free(graph->sources[s].fdl);
+        free(graph->sources[s].window);
+    }
+    for (int c = 0; c < RENDER_CHANNELS; c++) {
+        free(graph->acc[c]);
+        free(graph->tail[c]);
+        free(graph->fft_out[c]);
+        free(graph->fade_acc[c]);
+        free(graph->fade_new[c]);
+    }
+    free(graph->partial);
+    free(graph->fade_fir[0]);
+    free(graph->fade_fir[1]);
+    free(graph->sources);
+    free(graph->filters);
+    // Chunk 0 sums into acc
+    for (int k = 1; k < graph->num_chunks; k++) {
+        for (int c = 0; c < RENDER_CHANNELS; c++) {
+            free(graph->chunks[k].acc[c]);
+        }
+    }
+    free(graph->chunks);
+    render_set_pool(graph, NULL);
+    memset(graph, 0, sizeof(render_graph));
+}
+
+int render_set_pool(render_graph* graph, task_pool* pool) {
+    for (int w = 1; graph->pool && w < graph->pool->num_threads; w++) {
+        convolver_free(&graph->lanes[w - 1]);
+    }
+    free(graph->lanes);
+    graph->lanes = NULL;
+    graph->pool = NULL;
+    if (!pool || pool->num_threads == 1) {
+        graph->pool = pool;
+        return 0;
+    }
+
+    convolver* conv = graph->conv;
+    graph->lanes = calloc(pool->num_threads - 1, sizeof(convolver));
+    if (!graph->lanes) {
+        return -1;
+    }
+    for (int w = 1; w < pool->num_threads; w++) {
+        if (convolver_init(&graph->lanes[w - 1], conv->block_size,
+                           conv->num_partitions * conv->block_size) < 0) {
+            for (int k = 1; k < w; k++) {
+                convolver_free(&graph->lanes[k - 1]);
+            }
+            free(graph->lanes);
+            graph->lanes = NULL;
+            return -1;
+        }
+    }
+    graph->pool = pool;
+    return 0;
+}
+
+void render_reset(render_graph* graph) {
+    convolver* conv = graph->conv;
+
+    for (int s = 0; s < graph->num_sources; s++) {
+        render_source* src = &graph->sources[s];
+        if (src->fdl) {
+            memset(src->fdl, 0, sizeof(float) * conv->filter_len);
+        }
+        if (src->window) {
+            memset(src->window, 0, sizeof(float) * (graph->head_len - 1 + conv->block_size));
+        }
+    }
+    for (int c = 0; c < RENDER_CHANNELS; c++) {
+        memset(graph->tail[c], 0, sizeof(float) * conv->tail_len);
+        memset(graph->fft_out[c], 0, sizeof(float) * conv->block_size);
+    }
+    graph->block_pos = 0;
+}
+
+// Makes room for one more of `size` bytes in *nodes, doubling it when full
+static bool grow(void** nodes, int* max_nodes, int num_nodes, size_t size) {
+    if (num_nodes < *max_nodes) {
+        return true;
+    }
+    int max = *max_nodes > 0 ? 2 * *max_nodes : 4;
+    void* grown = realloc(*nodes, size * max);
+    if (!grown) {
+        return false;
+    }
+    *nodes = grown;
+    *max_nodes = max;
+    return true;
+}
+
+int render_add_source(render_graph* graph) {
+    convolver* conv = graph->conv;
+
+    if (!grow((void**)&graph->sources, &graph->max_sources, graph->num_sources,
+              sizeof(render_source))) {
+        return -1;
+    }
+    render_source* src = &graph->sources[graph->num_sources];
+    memset(src, 0, sizeof(render_source));
+
+    // A graph whose filters fit in the head has no FFT stage at all
+    if (conv->num_partitions > 0) {
+        src->fdl = calloc(conv->filter_len, sizeof(float));
+        if (!src->fdl) {
+            return -1;
+        }
+    }
+    if (graph->head_len > 0) {
+        src->window = calloc(graph->head_len - 1 + conv->block_size, sizeof(float));
+        if (!src->window) {
+            free(src->fdl);
+            return -1;
+        }
+    }
+    src->active = true;
+    return graph->num_sources++;
+}
+
+// Adds the chunk the next filter starts, if it starts one
+static bool add_chunk(render_graph* graph) {
+    if (graph->num_filters % RENDER_CHUNK != 0) {
+        return true;
+    }
+    if (!grow((void**)&graph->chunks, &graph->max_chunks, graph->num_chunks,
+              sizeof(render_chunk))) {
+        return false;
+    }
+    render_chunk* chunk = &graph->chunks[graph->num_chunks];
+    memset(chunk, 0, sizeof(render_chunk));
+    for (int c = 0; c < RENDER_CHANNELS; c++) {
+        chunk->acc[c] = graph->num_chunks == 0 ? graph->acc[c] :
+                        malloc(sizeof(float) * graph->conv->spectrum_len);
+        if (!chunk->acc[c]) {
+            for (int k = 0; k < c && graph->num_chunks > 0; k++) {
+                free(chunk->acc[k]);
+            }
+            return false;
+        }
+    }
+    graph->num_chunks++;
+    return true;
+}
+
+int render_add_filter(render_graph* graph, int source) {
+    if (!grow((void**)&graph->filters, &graph->max_filters, graph->num_filters,
+              sizeof(render_filter)) || !add_chunk(graph)) {
+        return -1;
+    }
+    render_filter* filter = &graph->filters[graph->num_filters];
+    memset(filter, 0, sizeof(render_filter));
+    filter->source = source;
+    return graph->num_filters++;
+}
+
+void render_set_input(render_graph* graph, int source, const float* in) {
+    graph->sources[source].in = in;
+}
+
+void render_set_active(render_graph* graph, int source, bool active) {
+    render_source* src = &graph->sources[source];
+    if (src->active == active) {
+        return;
+    }
+    src->active = active;
+
+    if (active) {
+        if (src->fdl) {
+            memset(src->fdl, 0, sizeof(float) * graph->conv->filter_len);
+        }
+        if (src->window) {
+            memset(src->window, 0, sizeof(float) * (graph->head_len - 1 + graph->conv->block_size));
+        }
+        return;
+    }
+    for (int f = 0; f < graph->num_filters; f++) {
+        render_filter* filter = &graph->filters[f];
+        if (filter->source == source) {
+            filter->head_l = filter->head_r = NULL;
+            filter->play_head_l = filter->play_head_r = NULL;
+            filter->hrtf_l = filter->hrtf_r = NULL;
+            filter->fade_fft = false;
+            filter->fade_fir = false;
+        }
+    }
+}
+
+void render_set_filter(render_graph* graph, int filter,
+                       const float* hrir_l, const float* hrir_r, int hrir_len,
+                       const float* hrtf_l, const float* hrtf_r) {
+    render_filter* f = &graph->filters[filter];
+    int head_taps = hrir_len < graph->head_len ? hrir_len : graph->head_len;
+    bool changed = false;
+
+    // A filter already playing fades out from where it is. Changing it again
+    // before the fade has run keeps the one that was actually heard.
+    if (f->hrtf_l && (hrtf_l != f->hrtf_l || hrtf_r != f->hrtf_r) &&
+            graph->conv->num_partitions > 0 && !f->fade_fft) {
+        f->fade_hrtf_l = f->hrtf_l;
+        f->fade_hrtf_r = f->hrtf_r;
+        f->fade_fft = true;
+        changed = true;
+    }
+    // The head switches at the next block boundary, see next_head(). One
+    // not playing yet starts right away.
+    if (f->play_head_l && f->head_l == f->play_head_l && head_taps > 0 &&
+            (hrir_l != f->head_l || hrir_r != f->head_r)) {
+        changed = true;
+    }
+    if (changed) {
+        graph->conv->stat_fades++;
+    }
+
+    f->head_l = hrir_l;
+    f->head_r = hrir_r;
+    f->head_taps = head_taps;
+    if (!f->play_head_l) {
+        f->play_head_l = hrir_l;
+        f->play_head_r = hrir_r;
+        f->play_head_taps = head_taps;
+    }
+    f->hrtf_l = hrtf_l;
+    f->hrtf_r = hrtf_r;
+}
+
+bool render_fading(const render_graph* graph) {
+    for (int f = 0; f < graph->num_filters; f++) {
+        const render_filter* filter = &graph->filters[f];
+        // Only the hybrid and direct modes play heads, partitioned mode
+        // never moves play_head_l on to head_l
+        bool head_waiting = graph->head_len > 0 && filter->head_l != filter->play_head_l;
+        if (filter->fade_fft || filter->fade_fir || head_waiting) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int render_max_hrir_len(const render_graph* graph) {
+    return graph->head_len + graph->conv->num_partitions * graph->conv->block_size;
+}
+
+// Worker `worker`'s transform buffers
+static convolver* lane(render_graph* graph, int worker) {
+    return worker == 0 ? graph->conv : &graph->lanes[worker - 1];
+}
+
+// Runs `fn` on tasks 0 to num_tasks - 1 of the graph, on its pool if it has
+// one
+static void run_chunks(render_graph* graph, task_pool_fn fn, int num_tasks) {
+    if (graph->pool) {
+        task_pool_run(graph->pool, fn, graph, num_tasks);
+        return;
+    }
+    for (int t = 0; t < num_tasks; t++) {
+        fn(graph, t, 0);
+    }
+}
+
+// One forward transform per active source of a chunk, into the newest FDL
+// slot, batched CONVOLVER_BATCH sources at a time
+static void analyze_chunk(void* data, int chunk, int worker) {
+    render_graph* graph = data;
+    convolver* conv = lane(graph, worker);
+    int end = (chunk + 1) * RENDER_CHUNK;
+    if (end > graph->num_sources) {
+        end = graph->num_sources;
+    }
+
+    const float* in[CONVOLVER_BATCH];
+    float* spectra[CONVOLVER_BATCH];
+    int count = 0;
+    for (int s = chunk * RENDER_CHUNK; s < end; s++) {
+        render_source* src = &graph->sources[s];
+        if (!src->active) {
+            continue;
+        }
+        src->fdl_head = (src->fdl_head + 1) % conv->num_partitions;
+        in[count] = src->window ? src->window + graph->head_len - 1 : src->in;
+        spectra[count] = src->fdl + src->fdl_head * conv->spectrum_len;
+        if (++count == CONVOLVER_BATCH) {
+            convolver_analyze(conv, count, in, graph->analyze_len, spectra);
+            count = 0;
+        }
+    }
+    if (count > 0) {
+        convolver_analyze(conv, count, in, graph->analyze_len, spectra);
+    }
+}
+
+// Every filter of a chunk reuses its source's delay line. The first one
+// overwrites the chunk's spectra, so they need no clearing.
+static void accumulate_chunk(void* data, int chunk, int worker) {
+    render_graph* graph = data;
+    render_chunk* part = &graph->chunks[chunk];
+    int end = (chunk + 1) * RENDER_CHUNK;
+    if (end > graph->num_filters) {
+        end = graph->num_filters;
+    }
+    (void)worker;
+
+    part->num_accumulated = 0;
+    for (int f = chunk * RENDER_CHUNK; f < end; f++) {
+        render_filter* filter = &graph->filters[f];
+        render_source* src = &graph->sources[filter->source];
+        if (!src->active) {
+            continue;
+        }
+        bool clear = part->num_accumulated++ == 0;
+        convolver_accumulate(graph->conv, src->fdl, src->fdl_head, filter->hrtf_l,
+                             part->acc[0], clear);
+        convolver_accumulate(graph->conv, src->fdl, src->fdl_head, filter->hrtf_r,
+                             part->acc[1], clear);
+    }
+}
+
+// FFT stage of one block: every source into its delay line, every filter
+// into both ears, every ear back into `out[c]` (block_size samples spaced
+// `stride` floats apart)
+static void render_block(render_graph* graph, int n, float** out, int stride) {
+    convolver* conv = graph->conv;
+
+    graph->analyze_len = n;
+    run_chunks(graph, analyze_chunk, (graph->num_sources + RENDER_CHUNK - 1) / RENDER_CHUNK);
+    for (int w = 1; graph->pool && w < graph->pool->num_threads; w++) {
+        conv->stat_transforms += graph->lanes[w - 1].stat_transforms;
+        conv->stat_batches += graph->lanes[w - 1].stat_batches;
+        convolver_reset_stats(&graph->lanes[w - 1]);
+    }
+
+    // Chunk 0 sums straight into the ears' spectra, the others are added on
+    // in order, however many threads summed them
+    run_chunks(graph, accumulate_chunk, graph->num_chunks);
+    int num_accumulated = graph->num_chunks > 0 ? graph->chunks[0].num_accumulated : 0;
+    for (int k = 1; k < graph->num_chunks; k++) {
+        render_chunk* part = &graph->chunks[k];
+        if (part->num_accumulated == 0) {
+            continue;
+        }
+        for (int c = 0; c < RENDER_CHANNELS; c++) {
+            if (num_accumulated == 0) {
+                memcpy(graph->acc[c], part->acc[c], sizeof(float) * conv->spectrum_len);
+                continue;
+            }
+            for (int i = 0; i < conv->spectrum_len; i++) {
+                graph->acc[c][i] += part->acc[c][i];
+            }
+        }
+        num_accumulated += part->num_accumulated;
+    }
+    if (num_accumulated == 0) {
+        for (int c = 0; c < RENDER_CHANNELS; c++) {
+            memset(graph->acc[c], 0, sizeof(float) * conv->spectrum_len);
+        }
+    }
+
+    // Filters that changed run their old and their new spectra once more,
+    // into what the old ones would add on top of the new
+    int num_fading = 0;
+    Uint64 fade_begin = 0;
+    for (int f = 0; f < graph->num_filters; f++) {
+        render_filter* filter = &graph->filters[f];
+        if (!filter->fade_fft) {
+            continue;
+        }
+        if (num_fading == 0) {
+            fade_begin = SDL_GetPerformanceCounter();
+        }
+        render_source* src = &graph->sources[filter->source];
+        bool clear = num_fading == 0;
+        convolver_accumulate(conv, src->fdl, src->fdl_head, filter->fade_hrtf_l, graph->fade_acc[0], clear);
+        convolver_accumulate(conv, src->fdl, src->fdl_head, filter->fade_hrtf_r, graph->fade_acc[1], clear);
+        convolver_accumulate(conv, src->fdl, src->fdl_head, filter->hrtf_l, graph->fade_new[0], clear);
+        convolver_accumulate(conv, src->fdl, src->fdl_head, filter->hrtf_r, graph->fade_new[1], clear);
+        filter->fade_fft = false;
+        num_fading++;
+    }
+    Uint64 fade_ticks = 0;
+    if (num_fading > 0) {
+        for (int c = 0; c < RENDER_CHANNELS; c++) {
+            for (int i = 0; i < conv->spectrum_len; i++) {
+                graph->fade_acc[c][i] -= graph->fade_new[c][i];
+            }
+        }
+        fade_ticks = SDL_GetPerformanceCounter() - fade_begin;
+    }
+
+    // One inverse transform per ear, both in the same batch
+    const float* acc[RENDER_CHANNELS] = { graph->acc[0], graph->acc[1] };
+    convolver_synthesize(conv, RENDER_CHANNELS, acc, graph->tail, out, stride, conv->block_size);
+
+    if (num_fading > 0) {
+        fade_begin = SDL_GetPerformanceCounter();
+        const float* diff[RENDER_CHANNELS] = { graph->fade_acc[0], graph->fade_acc[1] };
+        convolver_crossfade(conv, RENDER_CHANNELS, diff, out, stride, conv->block_size);
+        conv->stat_fade_ticks += fade_ticks + SDL_GetPerformanceCounter() - fade_begin;
+    }
+}
+
+static void render_process_partitioned(render_graph* graph, int num_samples, float* out) {
+    convolver* conv = graph->conv;
+
+    while (num_samples > 0) {
+        int n = num_samples < conv->block_size ? num_samples : conv->block_size;
+        float* block_out = (n == conv->block_size) ? out : graph->partial;
+        float* channel_out[RENDER_CHANNELS] = { block_out, block_out + 1 };
+
+        render_block(graph, n, channel_out, RENDER_CHANNELS);
+        if (block_out != out) {
+            memcpy(out, block_out, sizeof(float) * n * RENDER_CHANNELS);
+        }
+        conv->stat_blocks++;
+
+        for (int s = 0; s < graph->num_sources; s++) {
+            graph->sources[s].in += n;
+        }
+        out += n * RENDER_CHANNELS;
+        num_samples -= n;
+    }
+}
+
+// Head FIR of a filter whose taps changed at the start of the block,
+// crossfaded over the block with the FFT part's curve
+static void render_fade_fir(render_graph* graph, const render_filter* filter,
+                            const float* w, float* out, int n) {
+    float* old_out = graph->fade_fir[0];
+    float* new_out = graph->fade_fir[1];
+
+    memset(new_out, 0, sizeof(float) * n * RENDER_CHANNELS);
+    fir_stereo(w, filter->play_head_l, filter->play_head_r, filter->play_head_taps, new_out, n);
+
+    // Only the old taps and the mix are extra
+    Uint64 begin = SDL_GetPerformanceCounter();
+    memset(old_out, 0, sizeof(float) * n * RENDER_CHANNELS);
+    fir_stereo(w, filter->fade_head_l, filter->fade_head_r, filter->fade_head_taps, old_out, n);
+    for (int i = 0; i < n; i++) {
+        float g = convolver_fade_gain(graph->block_pos + i, graph->conv->block_size);
+        for (int c = 0; c < RENDER_CHANNELS; c++) {
+            int j = i * RENDER_CHANNELS + c;
+            out[j] += g * new_out[j] + (1 - g) * old_out[j];
+        }
+    }
+    graph->conv->stat_fade_ticks += SDL_GetPerformanceCounter() - begin;
+}
+
+// Takes each filter's head taps for the block starting, fading from the
+// last block's if they changed, as the FFT part does from its spectra
+static void next_head(render_graph* graph) {
+    for (int f = 0; f < graph->num_filters; f++) {
+        render_filter* filter = &graph->filters[f];
+        filter->fade_fir = false;
+        if (filter->head_l == filter->play_head_l && filter->head_r == filter->play_head_r) {
+            continue;
+        }
+        filter->fade_head_l = filter->play_head_l;
+        filter->fade_head_r = filter->play_head_r;
+        filter->fade_head_taps = filter->play_head_taps;
+        filter->fade_fir = filter->play_head_l && filter->head_taps > 0;
+        filter->play_head_l = filter->head_l;
+        filter->play_head_r = filter->head_r;
+        filter->play_head_taps = filter->head_taps;
+    }
+}
+
+// Hybrid and direct modes
+static void render_process_hybrid(render_graph* graph, int num_samples, float* out) {
+    convolver* conv = graph->conv;
+    const int history = graph->head_len - 1;
+
+    while (num_samples > 0) {
+        // Never run past the end of the current block
+        int n = conv->block_size - graph->block_pos;
+        if (n > num_samples) {
+            n = num_samples;
+        }
+
+        for (int s = 0; s < graph->num_sources; s++) {
+            render_source* src = &graph->sources[s];
+            if (src->active) {
+                memcpy(src->window + history + graph->block_pos, src->in, sizeof(float) * n);
+                src->in += n;
+            }
+        }
+
+        // The FFT part was computed when the previous block filled up
+        for (int i = 0; i < n; i++) {
+            for (int c = 0; c < RENDER_CHANNELS; c++) {
+                out[i * RENDER_CHANNELS + c] = graph->fft_out[c][graph->block_pos + i];
+            }
+        }
+
+        // Direct FIR over the head taps, both ears in one pass
+        for (int f = 0; f < graph->num_filters; f++) {
+            render_filter* filter = &graph->filters[f];
+            render_source* src = &graph->sources[filter->source];
+            if (!src->active) {
+                continue;
+            }
+            const float* w = src->window + history + graph->block_pos;
+            if (filter->fade_fir) {
+                render_fade_fir(graph, filter, w, out, n);
+            } else {
+                fir_stereo(w, filter->play_head_l, filter->play_head_r, filter->play_head_taps,
+                           out, n);
+            }
+        }
+
+        graph->block_pos += n;
+        out += n * RENDER_CHANNELS;
+        num_samples -= n;
+
+        if (graph->block_pos == conv->block_size) {
+            // The tail taps start one block in, so this block's FFT output is
+            // exactly what the next block needs
+            if (conv->num_partitions > 0) {
+                render_block(graph, conv->block_size, graph->fft_out, 1);
+            }
+
+            for (int s = 0; s < graph->num_sources; s++) {
+                render_source* src = &graph->sources[s];
+                if (src->active) {
+                    memmove(src->window, src->window + conv->block_size, sizeof(float) * history);
+                }
+            }
+            graph->block_pos = 0;
+            conv->stat_blocks++;
+            next_head(graph);
+        }
+    }
+}
+
+void render_process(render_graph* graph, int num_samples, float* out) {
+    Uint64 begin = SDL_GetPerformanceCounter();
+
+    if (graph->head_len > 0) {
+        render_process_hybrid(graph, num_samples, out);
+    } else {
+        render_process_partitioned(graph, num_samples, out);
+    }
+
+    graph->conv->stat_ticks += SDL_GetPerformanceCounter() - begin;
+}
+
+// Ticks per block to render a `hrir_len` filter in `mode`
+static double render_time_mode(render_mode mode, int block_size, int hrir_len) {
+    const int WARMUP_BLOCKS = 4;
+    const int TIMED_BLOCKS = 32;
+    const int total = (WARMUP_BLOCKS + TIMED_BLOCKS) * block_size;
+
+    convolver conv;
+    render_graph graph;
+    int head = (mode == RENDER_MODE_DIRECT) ? hrir_len : 0;
+    double ticks = -1;
+
+    float* in = malloc(sizeof(float) * total);
+    float* out = malloc(sizeof(float) * total * RENDER_CHANNELS);
+    float* hrir = malloc(sizeof(float) * hrir_len);
+    float* hrtf = NULL;
+
+    if (in && out && hrir && convolver_init(&conv, block_size, hrir_len - head) == 0) {
+        if (render_init(&graph, &conv, mode, hrir_len) == 0) {
+            hrtf = malloc(sizeof(float) * (conv.filter_len + 1));
+        }
+        if (hrtf) {
+            // Any decaying noise will do, only the timing matters
+            for (int i = 0; i < total; i++) {
+                in[i] = (float)(rand() % 2001 - 1000) / 1000.0f;
+            }
+            for (int i = 0; i < hrir_len; i++) {
+                hrir[i] = in[i] / (1 + i);
+            }
+            convolver_make_hrtf(&conv, hrir + head, hrir_len - head, 1, hrtf);
+
+            int src = render_add_source(&graph);
+            int filter = render_add_filter(&graph, src);
+            render_set_filter(&graph, filter, hrir, hrir, hrir_len, hrtf, hrtf);
+            render_set_input(&graph, src, in);
+
+            render_process(&graph, WARMUP_BLOCKS * block_size, out);
+            Uint64 begin = SDL_GetPerformanceCounter();
+            render_process(&graph, TIMED_BLOCKS * block_size, out);
+            ticks = (double)(SDL_GetPerformanceCounter() - begin) / TIMED_BLOCKS;
+        }
+        render_free(&graph);
+        convolver_free(&conv);
+    }
+
+    free(in);
+    free(out);
+    free(hrir);
+    free(hrtf);
+    return ticks;
+}
+
+// Modes already picked, so a shape is timed once per run. Past the last
+// slot the oldest is timed again.
+#define RENDER_MAX_PICKS 8
+typedef struct _render_pick {
+    int block_size;
+    int hrir_len;
+    render_mode mode;
+} render_pick;
+static render_pick picks[RENDER_MAX_PICKS];
+static int num_picks = 0;
+
+render_mode render_pick_mode(int block_size, int hrir_len) {
+    for (int p = 0; p < num_picks && p < RENDER_MAX_PICKS; p++) {
+        if (picks[p].block_size == block_size && picks[p].hrir_len == hrir_len) {
+            return picks[p].mode;
+        }
+    }
+
+    double fft = render_time_mode(RENDER_MODE_PARTITIONED, block_size, hrir_len);
+    double fir = render_time_mode(RENDER_MODE_DIRECT, block_size, hrir_len);
+    render_pick* pick = &picks[num_picks++ % RENDER_MAX_PICKS];
+    pick->block_size = block_size;
+    pick->hrir_len = hrir_len;
+    pick->mode = (fir >= 0 && fir < fft) ? RENDER_MODE_DIRECT : RENDER_MODE_PARTITIONED;
+    return pick->mode;
+}
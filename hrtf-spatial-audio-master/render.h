@@ -0,0 +1,177 @@
+// Render graph
+// Sources feed filters, filters feed the two ear channels. A filter is a
+// left/right HRTF pair. Each block, every source is transformed once into its
+// frequency-domain delay line, which is shared by all the filters that read
+// it. Filters multiply-accumulate into the ears' spectra, and each ear is
+// transformed back once, however many sources feed it. Sources are
+// transformed CONVOLVER_BATCH at a time, and both ears share one inverse.
+//
+// In hybrid mode (Gardner's non-uniform scheme) the first block_size taps of
+// every filter run as a direct FIR, sample by sample, and only the taps after
+// that go through the FFT partitions. The FFT part of a block is then not
+// needed until the next block, so output has no algorithmic latency and the
+// device callback can be any size, independent of the FFT block.
+//
+// Direct mode runs every tap as a FIR and skips the FFT. It wins for short
+// HRIRs at small block sizes; render_pick_mode() times both on this machine.
+//
+// A filter given new HRTFs crossfades to them instead of switching. The
+// next FFT block also runs the changed filters' old and new spectra into a
+// difference per ear. That difference takes one more inverse transform and
+// is faded out over the block. The direct FIR head takes its taps at the
+// same block boundaries as the FFT takes its spectra. Over the block after
+// a change it runs the old taps next to the new ones, with the same gain
+// curve as the FFT part, so the head and tail of a HRIR switch as one.
+// Both fade to what a hard switch at that boundary would play, whose first
+// block still carries the old filters' overlap from the one before.
+// Direct mode switches at block boundaries too. Filters that did not
+// change cost nothing extra.
+//
+// The FFT stage of a block runs in chunks of RENDER_CHUNK sources, then of
+// RENDER_CHUNK filters, which render_set_pool() spreads over a task_pool's
+// threads. Each filter chunk accumulates into spectra of its own, and the
+// chunks are added into the ears' spectra in order once all are done. The
+// chunks do not depend on the number of threads, so neither does a single
+// bit of the output.
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "convolver.h"
+#include "task_pool.h"
+
+#define RENDER_CHANNELS 2   // Left and right ear
+
+// Sources transformed, and filters accumulated, per task
+#define RENDER_CHUNK 16
+
+typedef enum {
+    RENDER_MODE_PARTITIONED,    // All taps in FFT partitions
+    RENDER_MODE_HYBRID,         // Direct FIR head plus FFT tail
+    RENDER_MODE_DIRECT,         // All taps in the direct FIR
+    RENDER_MODE_AUTO            // Resolve with render_pick_mode() first
+} render_mode;
+
+typedef struct _render_source {
+    const float* in;        // Next input sample, advanced by render_process()
+    float* fdl;             // Spectra of the last num_partitions blocks
+    int fdl_head;           // Slot of the current block
+    float* window;          // Hybrid/direct: head_len - 1 samples of history + the current block
+    bool active;            // Inactive sources and their filters are skipped
+} render_source;
+
+typedef struct _render_filter {
+    int source;
+    const float* head_l;        // First head_taps taps of the HRIRs
+    const float* head_r;
+    int head_taps;
+    const float* play_head_l;   // Head taken at the start of the current block
+    const float* play_head_r;
+    int play_head_taps;
+    const float* hrtf_l;        // Partitioned spectra from convolver_make_hrtf()
+    const float* hrtf_r;
+
+    // Filters being faded out, see render_set_filter()
+    const float* fade_head_l;
+    const float* fade_head_r;
+    int fade_head_taps;
+    const float* fade_hrtf_l;
+    const float* fade_hrtf_r;
+    bool fade_fft;              // The next FFT block fades from fade_hrtf_l/r
+    bool fade_fir;              // The current block fades from fade_head_l/r to play_head_l/r
+} render_filter;
+
+// RENDER_CHUNK consecutive filters, summed apart from the others
+typedef struct _render_chunk {
+    float* acc[RENDER_CHANNELS];    // The graph's own spectra for chunk 0
+    int num_accumulated;            // Filters in acc this block, 0 if it holds nothing
+} render_chunk;
+
+typedef struct _render_graph {
+    convolver* conv;
+    render_mode mode;
+    int head_len;           // Taps run as a direct FIR, 0 when partitioned
+    int block_pos;          // Hybrid/direct: samples of the current block seen so far
+
+    // Grown by render_add_source() and render_add_filter()
+    int num_sources;
+    int max_sources;
+    render_source* sources;
+
+    int num_filters;
+    int max_filters;
+    render_filter* filters;
+
+    float* acc[RENDER_CHANNELS];         // Accumulated spectrum per channel
+    float* tail[RENDER_CHANNELS];        // Overlap carried over per channel
+    float* partial;                      // Output of a block cut short
+    float* fft_out[RENDER_CHANNELS];     // Hybrid/direct: FFT part of the current block
+
+    float* fade_acc[RENDER_CHANNELS];    // Old minus new spectra of the filters fading
+    float* fade_new[RENDER_CHANNELS];    // New side of the same filters
+    float* fade_fir[2];                  // Hybrid/direct: old and new head of a fading filter
+
+    // Grown by render_add_filter(), one per RENDER_CHUNK filters
+    int num_chunks;
+    int max_chunks;
+    render_chunk* chunks;
+
+    task_pool* pool;        // Runs the chunks, NULL to run them on the caller
+    convolver* lanes;       // Transform buffers of pool workers 1 on, worker 0 uses conv
+    int analyze_len;        // Samples in the block being transformed
+} render_graph;
+
+// Returns 0 on success, -1 if allocation failed. The convolver's partitions
+// only cover the taps after head_len: block_size in hybrid mode, all of
+// `hrir_len` in direct mode.
+int render_init(render_graph* graph, convolver* conv, render_mode mode, int hrir_len);
+void render_free(render_graph* graph);
+
+// Runs the FFT stage's chunks on `pool`'s threads from now on, or on the
+// caller's alone for NULL. The pool must outlive the graph or the next
+// call. Returns 0 on success, -1 if allocation failed.
+int render_set_pool(render_graph* graph, task_pool* pool);
+
+// Clears the delay lines and tails, e.g. when playback restarts
+void render_reset(render_graph* graph);
+
+// Return the new node's index, or -1 if allocation failed
+int render_add_source(render_graph* graph);
+int render_add_filter(render_graph* graph, int source);
+
+void render_set_input(render_graph* graph, int source, const float* in);
+
+// Sources start active. An inactive source costs nothing, and its filters
+// forget their HRTFs, so the first ones set after it comes back start
+// without a crossfade. Coming back clears its history. Never allocates.
+void render_set_active(render_graph* graph, int source, bool active);
+
+// `hrir_l/r` are the full impulse responses, `hrtf_l/r` the
+// convolver_make_hrtf() spectra of their taps from head_len on. Once a
+// filter has been rendered, new ones crossfade from it, and the old ones
+// must stay valid until the end of the next block, or in hybrid and direct
+// modes of the block after it.
+void render_set_filter(render_graph* graph, int filter,
+                       const float* hrir_l, const float* hrir_r, int hrir_len,
+                       const float* hrtf_l, const float* hrtf_r);
+
+// True while a filter change has not finished fading, so the filters it
+// fades from are still needed
+bool render_fading(const render_graph* graph);
+
+// Longest filter the graph plays in full, longer ones are cut short
+int render_max_hrir_len(const render_graph* graph);
+
+// Renders `num_samples` frames of interleaved stereo into `out`.
+// Partitioned: one block at a time. Partitions assume every block is a whole
+// block_size long, so a shorter final block is zero-padded and the rest of
+// its output dropped; callers should ask for multiples of the block size.
+// Hybrid/direct: any number of samples, the FFT runs whenever a block fills.
+void render_process(render_graph* graph, int num_samples, float* out);
+
+// Times partitioned and direct rendering of a `hrir_len` filter at
+// `block_size` and returns the faster one. The answer is kept, so later
+// calls with the same sizes return at once. Call from one thread.
+render_mode render_pick_mode(int block_size, int hrir_len);
+
+#endif
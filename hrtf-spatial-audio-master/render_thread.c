@@ -0,0 +1,72 @@
+// Render thread
+// See render_thread.h
+
+#include "render_thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int worker_thread(void* data) {
+    render_thread* worker = data;
+    int block_len = worker->block_frames * 2;
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+
+    while (!SDL_AtomicGet(&worker->quit)) {
+        while (sample_ring_available(&worker->ring) + block_len <= worker->depth * block_len &&
+                !SDL_AtomicGet(&worker->quit)) {
+            worker->render(worker->data, worker->block, worker->block_frames);
+            sample_ring_write(&worker->ring, worker->block, block_len);
+        }
+        SDL_SemWait(worker->wake);
+    }
+    return 0;
+}
+
+int render_thread_start(render_thread* worker, render_thread_fn render, void* data,
+                        int block_frames, int depth) {
+    memset(worker, 0, sizeof(render_thread));
+    if (depth < 1 || depth > RENDER_THREAD_MAX_DEPTH) {
+        return -1;
+    }
+    worker->render = render;
+    worker->data = data;
+    worker->block_frames = block_frames;
+    worker->depth = depth;
+
+    worker->block = malloc(sizeof(float) * 2 * block_frames);
+    if (!worker->block || sample_ring_init(&worker->ring, depth * block_frames * 2) < 0) {
+        render_thread_stop(worker);
+        return -1;
+    }
+    worker->wake = SDL_CreateSemaphore(0);
+    if (!worker->wake) {
+        render_thread_stop(worker);
+        return -1;
+    }
+    worker->thread = SDL_CreateThread(worker_thread, "render", worker);
+    if (!worker->thread) {
+        render_thread_stop(worker);
+        return -1;
+    }
+    return 0;
+}
+
+void render_thread_stop(render_thread* worker) {
+    if (worker->thread) {
+        SDL_AtomicSet(&worker->quit, 1);
+        SDL_SemPost(worker->wake);
+        SDL_WaitThread(worker->thread, NULL);
+    }
+    if (worker->wake) {
+        SDL_DestroySemaphore(worker->wake);
+    }
+    free(worker->block);
+    sample_ring_free(&worker->ring);
+    memset(worker, 0, sizeof(render_thread));
+}
+
+void render_thread_read(render_thread* worker, float* out, int frames) {
+    int got = sample_ring_read(&worker->ring, out, frames * 2);
+    memset(out + got, 0, sizeof(float) * (frames * 2 - got));
+    SDL_SemPost(worker->wake);
+}
@@ -0,0 +1,55 @@
+// Render thread
+// Takes the DSP off the device's callback. A thread of its own renders
+// blocks ahead of playback into a sample_ring of interleaved stereo, and
+// the callback only copies from the ring, so a slow block is absorbed by
+// the blocks already waiting instead of missing the device's deadline.
+// Every read wakes the thread, which renders until the ring holds `depth`
+// blocks again and then sleeps. Whatever the callback used to consume, the
+// param_queue and the hrtf_loader's callback side, is consumed by the
+// thread instead.
+//
+// Rendering ahead adds `depth` blocks of latency: GUI changes, and the
+// direction published for the test page, reach the ears that much later.
+// If the ring ever runs dry the callback plays silence for the rest of its
+// buffer, and the ring counts an underrun.
+
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include "sample_ring.h"
+
+// Most blocks rendered ahead
+#define RENDER_THREAD_MAX_DEPTH 16
+
+// Renders `frames` frames of interleaved stereo into `out`
+typedef void (*render_thread_fn)(void* data, float* out, int frames);
+
+typedef struct _render_thread {
+    render_thread_fn render;
+    void* data;
+    int block_frames;       // Frames per render call
+    int depth;              // Blocks kept ahead
+    float* block;           // Rendered, on its way into the ring
+
+    sample_ring ring;
+    SDL_atomic_t quit;
+    SDL_sem* wake;
+    SDL_Thread* thread;
+} render_thread;
+
+// Starts rendering `depth` blocks of `block_frames` frames ahead with
+// `render`, which from then on is only called from the thread. Returns 0
+// on success, -1 if the depth is out of range, allocation failed or the
+// thread could not be started.
+int render_thread_start(render_thread* worker, render_thread_fn render, void* data,
+                        int block_frames, int depth);
+
+// Stops the thread once its current block is done. The callback must have
+// stopped.
+void render_thread_stop(render_thread* worker);
+
+// Callback side: copies `frames` frames of interleaved stereo into `out`,
+// silence for any not rendered yet
+void render_thread_read(render_thread* worker, float* out, int frames);
+
+#endif
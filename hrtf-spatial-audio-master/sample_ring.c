@@ -0,0 +1,92 @@
+// Sample ring
+// See sample_ring.h
+
+#include "sample_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int sample_ring_init(sample_ring* ring, int size) {
+    memset(ring, 0, sizeof(sample_ring));
+    ring->size = 1;
+    while (ring->size < size) {
+        ring->size *= 2;
+    }
+    ring->samples = calloc(ring->size, sizeof(float));
+    if (!ring->samples) {
+        return -1;
+    }
+    SDL_AtomicSet(&ring->written, 0);
+    SDL_AtomicSet(&ring->read, 0);
+    SDL_AtomicSet(&ring->underruns, 0);
+    SDL_AtomicSet(&ring->overruns, 0);
+    return 0;
+}
+
+void sample_ring_free(sample_ring* ring) {
+    free(ring->samples);
+    memset(ring, 0, sizeof(sample_ring));
+}
+
+int sample_ring_available(sample_ring* ring) {
+    // The counters run freely and wrap, only their difference matters
+    unsigned written = (unsigned)SDL_AtomicGet(&ring->written);
+    unsigned read = (unsigned)SDL_AtomicGet(&ring->read);
+    return (int)(written - read);
+}
+
+int sample_ring_space(sample_ring* ring) {
+    return ring->size - sample_ring_available(ring);
+}
+
+// Where the run of n samples from `start` sits in the ring: `first` of
+// them from `offset` on, and the rest, if it wraps, from the start
+static int first_run(const sample_ring* ring, unsigned start, int n, int* offset) {
+    *offset = (int)(start & (unsigned)(ring->size - 1));
+    return n < ring->size - *offset ? n : ring->size - *offset;
+}
+
+int sample_ring_write(sample_ring* ring, const float* in, int n) {
+    unsigned written = (unsigned)SDL_AtomicGet(&ring->written);
+    unsigned read = (unsigned)SDL_AtomicGet(&ring->read);
+    int space = ring->size - (int)(written - read);
+    if (n > space) {
+        SDL_AtomicAdd(&ring->overruns, 1);
+        n = space;
+    }
+    if (n <= 0) {
+        return 0;
+    }
+
+    // The consumer is done with these slots once it has published `read`
+    SDL_MemoryBarrierAcquire();
+    int offset;
+    int first = first_run(ring, written, n, &offset);
+    memcpy(ring->samples + offset, in, sizeof(float) * first);
+    memcpy(ring->samples, in + first, sizeof(float) * (n - first));
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&ring->written, (int)(written + n));
+    return n;
+}
+
+int sample_ring_read(sample_ring* ring, float* out, int n) {
+    unsigned read = (unsigned)SDL_AtomicGet(&ring->read);
+    unsigned written = (unsigned)SDL_AtomicGet(&ring->written);
+    int available = (int)(written - read);
+    if (n > available) {
+        SDL_AtomicAdd(&ring->underruns, 1);
+        n = available;
+    }
+    if (n <= 0) {
+        return 0;
+    }
+
+    SDL_MemoryBarrierAcquire();
+    int offset;
+    int first = first_run(ring, read, n, &offset);
+    memcpy(out, ring->samples + offset, sizeof(float) * first);
+    memcpy(out + first, ring->samples, sizeof(float) * (n - first));
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&ring->read, (int)(read + n));
+    return n;
+}
@@ -0,0 +1,41 @@
+// Sample ring
+// Carries mono float samples from one thread to another without locks,
+// like the param_queue does commands: one producer, one consumer, each
+// only ever writing its own counter, with release and acquire barriers
+// between the samples and the counts. Reads and writes move as many
+// samples as there are, or room for, and say how many that was, so
+// neither side ever waits on the other. Each side counts the times it came
+// up short, for the other threads to read.
+
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include "SDL2/include/SDL.h"
+
+typedef struct _sample_ring {
+    float* samples;
+    int size;               // A power of two
+    SDL_atomic_t written;   // Samples written so far, only the producer changes it
+    SDL_atomic_t read;      // Samples read so far, only the consumer changes it
+    SDL_atomic_t underruns; // Reads with fewer samples waiting than asked for
+    SDL_atomic_t overruns;  // Writes with less room than they needed
+} sample_ring;
+
+// Holds at least `size` samples. Returns 0 on success, -1 if allocation
+// failed.
+int sample_ring_init(sample_ring* ring, int size);
+void sample_ring_free(sample_ring* ring);
+
+// Samples waiting to be read
+int sample_ring_available(sample_ring* ring);
+
+// Room left for samples to be written
+int sample_ring_space(sample_ring* ring);
+
+// Producer side. Writes up to `n` samples, returns how many fitted.
+int sample_ring_write(sample_ring* ring, const float* in, int n);
+
+// Consumer side. Reads up to `n` samples, returns how many there were.
+int sample_ring_read(sample_ring* ring, float* out, int n);
+
+#endif
@@ -0,0 +1,42 @@
+// SIMD support shared by the DSP kernels
+// Every kernel is compiled into the same binary with a target attribute and
+// picked at runtime from SDL_cpuinfo, so the build needs no -m flags.
+// Each module's init function sets its kernel pointers, plain C where the
+// CPU has none of the extensions, and only ever sets them to the same
+// ones, so it can be called again by everything that needs them.
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "SDL2/include/SDL.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// Lets GCC and clang compile AVX2 code without building everything -mavx2
+#if defined(__GNUC__)
+#define SIMD_TARGET(x) __attribute__((target(x)))
+#else
+#define SIMD_TARGET(x)
+#endif
+
+#ifdef SIMD_X86
+// SDL 2.0.12 has no SDL_HasFMA
+static inline SDL_bool simd_has_fma(void) {
+#if defined(__GNUC__)
+    return __builtin_cpu_supports("fma") ? SDL_TRUE : SDL_FALSE;
+#else
+    // Every CPU shipped with AVX2 so far also has FMA3
+    return SDL_HasAVX2();
+#endif
+}
+#endif
+
+#endif
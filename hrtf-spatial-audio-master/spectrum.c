@@ -0,0 +1,237 @@
+// Complex spectrum kernels
+// See spectrum.h
+//
+// With the real and imaginary parts in separate arrays, a vector holds the
+// same part of consecutive bins and a complex product is four plain vector
+// multiplies, with no shuffles to pull pairs apart.
+
+#include "spectrum.h"
+
+#include "simd.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int spectrum_padded_bins(int num_bins) {
+    return (num_bins + SPECTRUM_WIDTH - 1) / SPECTRUM_WIDTH * SPECTRUM_WIDTH;
+}
+
+static void spectrum_mul_scalar(const float* a, const float* b, float* out, int num_bins) {
+    const float* a_im = a + num_bins;
+    const float* b_im = b + num_bins;
+    float* out_im = out + num_bins;
+
+    for (int i = 0; i < num_bins; i++) {
+        float re = a[i] * b[i] - a_im[i] * b_im[i];
+        float im = a[i] * b_im[i] + a_im[i] * b[i];
+        out[i] = re;
+        out_im[i] = im;
+    }
+}
+
+static void spectrum_mac_scalar(const float* a, const float* b, float* out, int num_bins) {
+    const float* a_im = a + num_bins;
+    const float* b_im = b + num_bins;
+    float* out_im = out + num_bins;
+
+    for (int i = 0; i < num_bins; i++) {
+        out[i] += a[i] * b[i] - a_im[i] * b_im[i];
+        out_im[i] += a[i] * b_im[i] + a_im[i] * b[i];
+    }
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET("sse")
+static void spectrum_mul_sse(const float* a, const float* b, float* out, int num_bins) {
+    const int n = num_bins;
+
+    for (int i = 0; i < n; i += 4) {
+        __m128 ar = _mm_loadu_ps(a + i), ai = _mm_loadu_ps(a + n + i);
+        __m128 br = _mm_loadu_ps(b + i), bi = _mm_loadu_ps(b + n + i);
+        __m128 re = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+        __m128 im = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+        _mm_storeu_ps(out + i, re);
+        _mm_storeu_ps(out + n + i, im);
+    }
+}
+
+SIMD_TARGET("sse")
+static void spectrum_mac_sse(const float* a, const float* b, float* out, int num_bins) {
+    const int n = num_bins;
+
+    for (int i = 0; i < n; i += 4) {
+        __m128 ar = _mm_loadu_ps(a + i), ai = _mm_loadu_ps(a + n + i);
+        __m128 br = _mm_loadu_ps(b + i), bi = _mm_loadu_ps(b + n + i);
+        __m128 re = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+        __m128 im = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), re));
+        _mm_storeu_ps(out + n + i, _mm_add_ps(_mm_loadu_ps(out + n + i), im));
+    }
+}
+
+SIMD_TARGET("avx2,fma")
+static void spectrum_mul_avx2(const float* a, const float* b, float* out, int num_bins) {
+    const int n = num_bins;
+
+    for (int i = 0; i < n; i += 8) {
+        __m256 ar = _mm256_loadu_ps(a + i), ai = _mm256_loadu_ps(a + n + i);
+        __m256 br = _mm256_loadu_ps(b + i), bi = _mm256_loadu_ps(b + n + i);
+        __m256 re = _mm256_fmsub_ps(ar, br, _mm256_mul_ps(ai, bi));
+        __m256 im = _mm256_fmadd_ps(ar, bi, _mm256_mul_ps(ai, br));
+        _mm256_storeu_ps(out + i, re);
+        _mm256_storeu_ps(out + n + i, im);
+    }
+}
+
+SIMD_TARGET("avx2,fma")
+static void spectrum_mac_avx2(const float* a, const float* b, float* out, int num_bins) {
+    const int n = num_bins;
+
+    for (int i = 0; i < n; i += 8) {
+        __m256 ar = _mm256_loadu_ps(a + i), ai = _mm256_loadu_ps(a + n + i);
+        __m256 br = _mm256_loadu_ps(b + i), bi = _mm256_loadu_ps(b + n + i);
+        __m256 re = _mm256_loadu_ps(out + i);
+        __m256 im = _mm256_loadu_ps(out + n + i);
+        re = _mm256_fnmadd_ps(ai, bi, _mm256_fmadd_ps(ar, br, re));
+        im = _mm256_fmadd_ps(ai, br, _mm256_fmadd_ps(ar, bi, im));
+        _mm256_storeu_ps(out + i, re);
+        _mm256_storeu_ps(out + n + i, im);
+    }
+}
+
+static SDL_bool spectrum_has_avx2(void) {
+    return (SDL_HasAVX2() && simd_has_fma()) ? SDL_TRUE : SDL_FALSE;
+}
+#endif
+
+#ifdef SIMD_NEON
+static void spectrum_mul_neon(const float* a, const float* b, float* out, int num_bins) {
+    const int n = num_bins;
+
+    for (int i = 0; i < n; i += 4) {
+        float32x4_t ar = vld1q_f32(a + i), ai = vld1q_f32(a + n + i);
+        float32x4_t br = vld1q_f32(b + i), bi = vld1q_f32(b + n + i);
+        float32x4_t re = vmlsq_f32(vmulq_f32(ar, br), ai, bi);
+        float32x4_t im = vmlaq_f32(vmulq_f32(ar, bi), ai, br);
+        vst1q_f32(out + i, re);
+        vst1q_f32(out + n + i, im);
+    }
+}
+
+static void spectrum_mac_neon(const float* a, const float* b, float* out, int num_bins) {
+    const int n = num_bins;
+
+    for (int i = 0; i < n; i += 4) {
+        float32x4_t ar = vld1q_f32(a + i), ai = vld1q_f32(a + n + i);
+        float32x4_t br = vld1q_f32(b + i), bi = vld1q_f32(b + n + i);
+        float32x4_t re = vmlaq_f32(vld1q_f32(out + i), ar, br);
+        float32x4_t im = vmlaq_f32(vld1q_f32(out + n + i), ar, bi);
+        vst1q_f32(out + i, vmlsq_f32(re, ai, bi));
+        vst1q_f32(out + n + i, vmlaq_f32(im, ai, br));
+    }
+}
+#endif
+
+static SDL_bool spectrum_has_scalar(void) {
+    return SDL_TRUE;
+}
+
+typedef struct _spectrum_kernel {
+    const char* name;
+    spectrum_fn mul;
+    spectrum_fn mac;
+    SDL_bool (*supported)(void);
+} spectrum_kernel;
+
+// Slowest first, spectrum_init() keeps the last one supported
+static const spectrum_kernel spectrum_kernels[] = {
+    { "scalar", spectrum_mul_scalar, spectrum_mac_scalar, spectrum_has_scalar },
+#ifdef SIMD_X86
+    { "SSE", spectrum_mul_sse, spectrum_mac_sse, SDL_HasSSE },
+    { "AVX2", spectrum_mul_avx2, spectrum_mac_avx2, spectrum_has_avx2 },
+#endif
+#ifdef SIMD_NEON
+    { "NEON", spectrum_mul_neon, spectrum_mac_neon, SDL_HasNEON },
+#endif
+};
+static const int SPECTRUM_NUM_KERNELS = sizeof(spectrum_kernels) / sizeof(spectrum_kernels[0]);
+
+static const spectrum_kernel* spectrum_active = &spectrum_kernels[0];
+
+void spectrum_init(void) {
+    spectrum_active = &spectrum_kernels[0];
+    for (int k = 1; k < SPECTRUM_NUM_KERNELS; k++) {
+        if (spectrum_kernels[k].supported()) {
+            spectrum_active = &spectrum_kernels[k];
+        }
+    }
+}
+
+const char* spectrum_kernel_name(void) {
+    return spectrum_active->name;
+}
+
+void spectrum_mul(const float* a, const float* b, float* out, int num_bins) {
+    spectrum_active->mul(a, b, out, num_bins);
+}
+
+void spectrum_mac(const float* a, const float* b, float* out, int num_bins) {
+    spectrum_active->mac(a, b, out, num_bins);
+}
+
+// Nanoseconds per call of `fn`, averaged over enough calls to cover about
+// a million bins
+static double spectrum_time(spectrum_fn fn, const float* a, const float* b, float* out,
+                            int num_bins) {
+    const int reps = 1 + (1 << 20) / num_bins;
+
+    fn(a, b, out, num_bins);
+    Uint64 begin = SDL_GetPerformanceCounter();
+    for (int r = 0; r < reps; r++) {
+        fn(a, b, out, num_bins);
+    }
+    Uint64 ticks = SDL_GetPerformanceCounter() - begin;
+    return (double)ticks * 1e9 / SDL_GetPerformanceFrequency() / reps;
+}
+
+void spectrum_benchmark(void) {
+    // Bins of the real FFT sizes the convolver uses, 64 ... 2048 points
+    const int SIZES[] = { 33, 65, 129, 257, 513, 1025 };
+    const int NUM_SIZES = sizeof(SIZES) / sizeof(SIZES[0]);
+    const int max_bins = spectrum_padded_bins(SIZES[NUM_SIZES - 1]);
+
+    float* a = malloc(sizeof(float) * 2 * max_bins);
+    float* b = malloc(sizeof(float) * 2 * max_bins);
+    float* out = calloc(2 * max_bins, sizeof(float));
+    if (!a || !b || !out) {
+        printf("Failed to allocate benchmark buffers\n");
+        free(a);
+        free(b);
+        free(out);
+        return;
+    }
+    for (int i = 0; i < 2 * max_bins; i++) {
+        a[i] = (float)(rand() % 2001 - 1000) / 1000.0f;
+        b[i] = (float)(rand() % 2001 - 1000) / 1000.0f;
+    }
+
+    printf("Spectrum kernels, bins/ns (multiply / multiply-accumulate):\n");
+    for (int k = 0; k < SPECTRUM_NUM_KERNELS; k++) {
+        const spectrum_kernel* kernel = &spectrum_kernels[k];
+        if (!kernel->supported()) {
+            continue;
+        }
+        printf("  %-7s", kernel->name);
+        for (int s = 0; s < NUM_SIZES; s++) {
+            int bins = spectrum_padded_bins(SIZES[s]);
+            double mul = spectrum_time(kernel->mul, a, b, out, bins);
+            double mac = spectrum_time(kernel->mac, a, b, out, bins);
+            printf("  %4d: %5.2f / %5.2f", SIZES[s], SIZES[s] / mul, SIZES[s] / mac);
+        }
+        printf("\n");
+    }
+
+    free(a);
+    free(b);
+    free(out);
+}
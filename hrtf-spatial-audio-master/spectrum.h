@@ -0,0 +1,35 @@
+// Complex spectrum kernels
+// Spectra are stored split rather than as complex pairs: `num_bins`
+// real parts followed by `num_bins` imaginary parts, with num_bins padded to
+// a multiple of SPECTRUM_WIDTH so the SIMD kernels never need a remainder
+// loop. Padding bins are kept at zero.
+// There are SSE, AVX2 (with FMA) and NEON versions, see simd.h.
+
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+// Bins per widest vector, and the padding unit of split spectra
+#define SPECTRUM_WIDTH 8
+
+typedef void (*spectrum_fn)(const float* a, const float* b, float* out, int num_bins);
+
+// Rounds a transform's bin count up to the padded split length
+int spectrum_padded_bins(int num_bins);
+
+// Chooses the spectrum_mul() and spectrum_mac() kernels, convolver_init()
+// calls it
+void spectrum_init(void);
+const char* spectrum_kernel_name(void);
+
+// Split spectra of `num_bins` padded bins (a multiple of SPECTRUM_WIDTH).
+// out = a * b, bin by bin. `out` may alias `a` or `b`.
+void spectrum_mul(const float* a, const float* b, float* out, int num_bins);
+
+// out += a * b, bin by bin
+void spectrum_mac(const float* a, const float* b, float* out, int num_bins);
+
+// Times every kernel this CPU supports at a few transform sizes and prints
+// bins per nanosecond
+void spectrum_benchmark(void);
+
+#endif
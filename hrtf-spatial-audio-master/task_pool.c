@@ -0,0 +1,171 @@
+// Work-stealing task pool
+// See task_pool.h
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "task_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#define RANGE(first, end) ((int)((Uint32)(first) | (Uint32)(end) << 16))
+#define RANGE_FIRST(range) ((int)((Uint32)(range) & 0xffff))
+#define RANGE_END(range) ((int)((Uint32)(range) >> 16))
+
+// Pins the calling thread to `core`, wrapped round the cores there are.
+// Elsewhere the scheduler places it.
+static void pin_to_core(int core) {
+    core %= SDL_GetCPUCount();
+#ifdef _WIN32
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+// Takes the first task left in `worker`'s range, or the last one when
+// stealing. Returns -1 if there is none.
+static int take(task_pool_worker* worker, bool steal) {
+    for (;;) {
+        int range = SDL_AtomicGet(&worker->range);
+        int first = RANGE_FIRST(range);
+        int end = RANGE_END(range);
+        if (first >= end) {
+            return -1;
+        }
+        int left = steal ? RANGE(first, end - 1) : RANGE(first + 1, end);
+        if (SDL_AtomicCAS(&worker->range, range, left)) {
+            return steal ? end - 1 : first;
+        }
+    }
+}
+
+// Runs tasks as worker `index` until none are left, its own and then the
+// others'. Returns whether it finished the last task of the run.
+static bool work(task_pool* pool, int index) {
+    bool last = false;
+    for (;;) {
+        int task = take(&pool->workers[index], false);
+        for (int k = 1; k < pool->num_threads && task < 0; k++) {
+            task = take(&pool->workers[(index + k) % pool->num_threads], true);
+        }
+        if (task < 0) {
+            return last;
+        }
+        // Read while the run cannot end, the caller may start the next one
+        // as soon as the count is in
+        int num_tasks = pool->num_tasks;
+        pool->fn(pool->data, task, index);
+        last = SDL_AtomicAdd(&pool->done, 1) == num_tasks - 1;
+    }
+}
+
+static int worker_thread(void* data) {
+    task_pool_worker* worker = data;
+    task_pool* pool = worker->pool;
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+    if (pool->pin) {
+        pin_to_core(worker->index);
+    }
+
+    for (;;) {
+        SDL_SemWait(worker->wake);
+        if (SDL_AtomicGet(&pool->quit)) {
+            return 0;
+        }
+        if (work(pool, worker->index)) {
+            SDL_SemPost(pool->finished);
+        }
+    }
+}
+
+int task_pool_init(task_pool* pool, int num_threads, bool pin) {
+    memset(pool, 0, sizeof(task_pool));
+    if (num_threads < 1 || num_threads > TASK_POOL_MAX_THREADS) {
+        return -1;
+    }
+    pool->pin = pin;
+    pool->workers = calloc(num_threads, sizeof(task_pool_worker));
+    pool->finished = SDL_CreateSemaphore(0);
+    if (!pool->workers || !pool->finished) {
+        task_pool_free(pool);
+        return -1;
+    }
+
+    // Worker 0 is the caller's
+    pool->num_threads = 1;
+    pool->workers[0].pool = pool;
+    while (pool->num_threads < num_threads) {
+        task_pool_worker* worker = &pool->workers[pool->num_threads];
+        worker->pool = pool;
+        worker->index = pool->num_threads;
+        worker->wake = SDL_CreateSemaphore(0);
+        if (!worker->wake) {
+            task_pool_free(pool);
+            return -1;
+        }
+        worker->thread = SDL_CreateThread(worker_thread, "task pool", worker);
+        if (!worker->thread) {
+            SDL_DestroySemaphore(worker->wake);
+            task_pool_free(pool);
+            return -1;
+        }
+        pool->num_threads++;
+    }
+    return 0;
+}
+
+void task_pool_free(task_pool* pool) {
+    SDL_AtomicSet(&pool->quit, 1);
+    for (int w = 1; w < pool->num_threads; w++) {
+        SDL_SemPost(pool->workers[w].wake);
+        SDL_WaitThread(pool->workers[w].thread, NULL);
+        SDL_DestroySemaphore(pool->workers[w].wake);
+    }
+    if (pool->finished) {
+        SDL_DestroySemaphore(pool->finished);
+    }
+    free(pool->workers);
+    memset(pool, 0, sizeof(task_pool));
+}
+
+void task_pool_run(task_pool* pool, task_pool_fn fn, void* data, int num_tasks) {
+    if (num_tasks <= 0) {
+        return;
+    }
+    // Set before any range is, so a worker still looking for work from the
+    // last run only takes tasks of this one along with it
+    pool->fn = fn;
+    pool->data = data;
+    pool->num_tasks = num_tasks;
+    SDL_AtomicSet(&pool->done, 0);
+
+    for (int w = 0; w < pool->num_threads; w++) {
+        int first = num_tasks * w / pool->num_threads;
+        int end = num_tasks * (w + 1) / pool->num_threads;
+        SDL_AtomicSet(&pool->workers[w].range, RANGE(first, end));
+    }
+    // Workers without a share of their own would only steal
+    for (int w = 1; w < pool->num_threads; w++) {
+        int range = SDL_AtomicGet(&pool->workers[w].range);
+        if (RANGE_FIRST(range) < RANGE_END(range)) {
+            SDL_SemPost(pool->workers[w].wake);
+        }
+    }
+
+    if (!work(pool, 0)) {
+        SDL_SemWait(pool->finished);
+    }
+}
@@ -0,0 +1,68 @@
+// Work-stealing task pool
+// Runs the tasks 0 to num_tasks - 1 of a function across a fixed set of
+// threads and returns once all of them are done. The thread calling
+// task_pool_run() is worker 0 and works too, so a pool of one thread is
+// just a loop. Every run deals the tasks out as one contiguous range per
+// worker. A worker takes its own from the front, and one that runs out
+// steals from the back of the others', so a worker held up by the rest of
+// the system costs the run only the task it is on.
+//
+// The pool's threads sleep on a semaphore each between runs, and the last
+// task done wakes the caller if it is waiting. Each one is pinned to a core
+// of its own, 1 to num_threads - 1, where the system allows it, leaving
+// core 0 to the caller and the device.
+//
+// Which worker runs a task depends on timing, so tasks that must add up to
+// the same result every time each write somewhere of their own, and the
+// caller combines them in task order afterwards.
+
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include "SDL2/include/SDL.h"
+
+#include <stdbool.h>
+
+#define TASK_POOL_MAX_THREADS 64
+
+// Most tasks in one run, as a range fits in one atomic
+#define TASK_POOL_MAX_TASKS 0xffff
+
+// Runs task `task` on worker `worker`, 0 to num_threads - 1
+typedef void (*task_pool_fn)(void* data, int task, int worker);
+
+typedef struct _task_pool_worker {
+    SDL_atomic_t range;     // Tasks left: the first in the low 16 bits, one past the last above
+    SDL_sem* wake;
+    SDL_Thread* thread;
+    struct _task_pool* pool;
+    int index;
+} task_pool_worker;
+
+typedef struct _task_pool {
+    int num_threads;
+    bool pin;
+    task_pool_worker* workers;
+
+    // The current run
+    task_pool_fn fn;
+    void* data;
+    int num_tasks;
+    SDL_atomic_t done;
+    SDL_sem* finished;      // Posted by whoever finishes the last task, but the caller
+
+    SDL_atomic_t quit;
+} task_pool;
+
+// Starts `num_threads` - 1 threads, pinned to cores if `pin` is set.
+// Returns 0 on success, -1 if the count is out of range, allocation failed
+// or a thread could not be started.
+int task_pool_init(task_pool* pool, int num_threads, bool pin);
+void task_pool_free(task_pool* pool);
+
+// Runs `fn` on every task from 0 to `num_tasks` - 1, at most
+// TASK_POOL_MAX_TASKS, and returns when all are done. Only one thread may
+// run tasks at a time.
+void task_pool_run(task_pool* pool, task_pool_fn fn, void* data, int num_tasks);
+
+#endif
@@ -0,0 +1,109 @@
+// Source trajectories
+// See trajectory.h
+
+#include "trajectory.h"
+
+#include <math.h>
+#include <string.h>
+
+void trajectory_ping_pong(trajectory* path, float start, float end, float elevation,
+                          float speed, int sample_rate) {
+    memset(path, 0, sizeof(trajectory));
+    path->mode = TRAJECTORY_PING_PONG;
+    path->sample_rate = sample_rate;
+    path->start_azimuth = start;
+    path->elevation = elevation;
+    path->speed = speed;
+
+    // 0 to 360 is a whole circle, not no distance at all
+    path->span = fmodf(end - start, 360.0f);
+    if (path->span < 0 || (path->span == 0 && end != start)) {
+        path->span += 360.0f;
+    }
+}
+
+void trajectory_orbit(trajectory* path, float start, float elevation, float speed,
+                      int sample_rate) {
+    memset(path, 0, sizeof(trajectory));
+    path->mode = TRAJECTORY_ORBIT;
+    path->sample_rate = sample_rate;
+    path->start_azimuth = start;
+    path->elevation = elevation;
+    path->speed = speed;
+}
+
+int trajectory_keyframes(trajectory* path, const trajectory_key* keys, int num_keys, bool loop,
+                         int sample_rate) {
+    if (num_keys < 1 || num_keys > TRAJECTORY_MAX_KEYS) {
+        return -1;
+    }
+    memset(path, 0, sizeof(trajectory));
+    path->mode = TRAJECTORY_KEYFRAMES;
+    path->sample_rate = sample_rate;
+    path->num_keys = num_keys;
+    path->loop = loop;
+    for (int k = 0; k < num_keys; k++) {
+        path->key_time[k] = (Uint64)llround(keys[k].time * sample_rate);
+        path->key_azimuth[k] = keys[k].azimuth;
+        path->key_elevation[k] = keys[k].elevation;
+    }
+    return 0;
+}
+
+void trajectory_set_speed(trajectory* path, float speed) {
+    path->speed = speed;
+}
+
+static float wrap_azimuth(float azimuth) {
+    azimuth = fmodf(azimuth, 360.0f);
+    return azimuth < 0 ? azimuth + 360.0f : azimuth;
+}
+
+void trajectory_direction(const trajectory* path, float* azimuth, float* elevation) {
+    if (path->mode == TRAJECTORY_KEYFRAMES) {
+        int k = path->key;
+        *azimuth = path->key_azimuth[k];
+        *elevation = path->key_elevation[k];
+        if (k + 1 < path->num_keys && path->time > path->key_time[k]) {
+            float t = (float)(path->time - path->key_time[k]) /
+                      (float)(path->key_time[k + 1] - path->key_time[k]);
+            *azimuth += t * (path->key_azimuth[k + 1] - path->key_azimuth[k]);
+            *elevation += t * (path->key_elevation[k + 1] - path->key_elevation[k]);
+        }
+        *azimuth = wrap_azimuth(*azimuth);
+        return;
+    }
+
+    // Ping-pong goes out for one span and comes back for another
+    float offset = (float)path->travelled;
+    if (path->mode == TRAJECTORY_PING_PONG && offset > path->span) {
+        offset = 2 * path->span - offset;
+    }
+    *azimuth = wrap_azimuth(path->start_azimuth + offset);
+    *elevation = path->elevation;
+}
+
+void trajectory_advance(trajectory* path, int num_samples) {
+    path->time += num_samples;
+
+    if (path->mode == TRAJECTORY_KEYFRAMES) {
+        Uint64 end = path->key_time[path->num_keys - 1];
+        if (path->loop && end > 0 && path->time >= end) {
+            path->time %= end;
+            path->key = 0;
+        }
+        while (path->key + 1 < path->num_keys && path->time >= path->key_time[path->key + 1]) {
+            path->key++;
+        }
+        return;
+    }
+
+    double period = path->mode == TRAJECTORY_PING_PONG ? 2.0 * path->span : 360.0;
+    if (period > 0) {
+        path->travelled += (double)num_samples * path->speed / path->sample_rate;
+        path->travelled = fmod(path->travelled, period);
+        if (path->travelled < 0) {
+            path->travelled += period;
+        }
+    }
+}
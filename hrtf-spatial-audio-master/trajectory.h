@@ -0,0 +1,81 @@
+// Source trajectories
+// A trajectory gives a source's direction at any sample time, independent
+// of the audio it plays or the size of the blocks it is rendered in. The
+// caller asks for the direction at the start of each block and then moves
+// the clock on by the block's length.
+//
+// Ping-pong and orbit modes run at a constant angular velocity and are
+// evaluated in closed form from the distance travelled. Keyframe mode
+// interpolates linearly between timed directions and keeps a cursor on the
+// current segment, so time moving forward costs the same whatever the
+// number of keys.
+
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "SDL2/include/SDL.h"
+
+#include <stdbool.h>
+
+#define TRAJECTORY_MAX_KEYS 64
+
+typedef enum {
+    TRAJECTORY_PING_PONG,   // Back and forth between two azimuths
+    TRAJECTORY_ORBIT,       // Round and round from one azimuth
+    TRAJECTORY_KEYFRAMES    // Through timed directions, optionally looping
+} trajectory_mode;
+
+typedef struct _trajectory_key {
+    double time;            // Seconds from the start
+    float azimuth;          // Degrees, not wrapped, so keys can go the long way round
+    float elevation;
+} trajectory_key;
+
+typedef struct _trajectory {
+    trajectory_mode mode;
+    int sample_rate;
+    Uint64 time;            // Samples since the start, or since the last loop
+
+    // Ping-pong and orbit
+    float start_azimuth;
+    float span;             // Ping-pong: degrees from start to end
+    float elevation;
+    float speed;            // Degrees per second
+    double travelled;       // Degrees moved, wrapped to one period
+
+    // Keyframes, with times in samples
+    int num_keys;
+    Uint64 key_time[TRAJECTORY_MAX_KEYS];
+    float key_azimuth[TRAJECTORY_MAX_KEYS];
+    float key_elevation[TRAJECTORY_MAX_KEYS];
+    bool loop;
+    int key;                // Segment the current time falls in
+} trajectory;
+
+// Back and forth from `start` to `end` (clockwise, in degrees) and back.
+// Equal azimuths hold still.
+void trajectory_ping_pong(trajectory* path, float start, float end, float elevation,
+                          float speed, int sample_rate);
+
+// Clockwise from `start` at `speed` degrees per second, negative for
+// anticlockwise
+void trajectory_orbit(trajectory* path, float start, float elevation, float speed,
+                      int sample_rate);
+
+// Through `num_keys` directions in time order, holding the last one unless
+// `loop` starts again from the first. Returns 0 on success, -1 if there
+// are no keys or more than TRAJECTORY_MAX_KEYS.
+int trajectory_keyframes(trajectory* path, const trajectory_key* keys, int num_keys, bool loop,
+                         int sample_rate);
+
+// Ping-pong and orbit: changes the angular velocity from the current
+// position on
+void trajectory_set_speed(trajectory* path, float speed);
+
+// Direction at the current time, azimuth wrapped to 0 ... 360
+void trajectory_direction(const trajectory* path, float* azimuth, float* elevation);
+
+// Moves the current time on by `num_samples`
+void trajectory_advance(trajectory* path, int num_samples);
+
+#endif
@@ -0,0 +1,467 @@
+// Virtual loudspeakers
+// See vbap.h
+
+#include "vbap.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+typedef struct _vbap_preset {
+    const char* name;
+    int count;
+    float directions[2 * VBAP_MAX_SPEAKERS];
+} vbap_preset;
+
+static const vbap_preset VBAP_PRESETS[] = {
+    // Eight round the head
+    { "ring8", 8, { 0, 0, 45, 0, 90, 0, 135, 0, 180, 0, 225, 0, 270, 0, 315, 0 } },
+    // 7.1 at ear height, four more at 40 degrees up
+    { "7.1.4", 11, { 0, 0, 30, 0, 330, 0, 90, 0, 270, 0, 135, 0, 225, 0,
+                     45, 40, 315, 40, 135, 40, 225, 40 } },
+    // Rings below, at and above the ears, and the top
+    { "sphere", 17, { 0, -40, 90, -40, 180, -40, 270, -40,
+                      0, 0, 45, 0, 90, 0, 135, 0, 180, 0, 225, 0, 270, 0, 315, 0,
+                      45, 40, 135, 40, 225, 40, 315, 40, 0, 90 } },
+};
+#define VBAP_NUM_PRESETS ((int)(sizeof(VBAP_PRESETS) / sizeof(VBAP_PRESETS[0])))
+
+// Largest change in a speaker's gain allowed between directions a fraction
+// of a degree apart where faces cover both, any more is a jump
+#define VBAP_MAX_JUMP 0.05
+
+// Times a step between table entries is halved looking for a jump, down to
+// under a hundredth of a degree
+#define VBAP_JUMP_DEPTH 8
+
+// Speakers panned between, with the inverse of the matrix of their unit
+// vectors, which maps a direction to their gains
+typedef struct _vbap_face {
+    int count;              // 3, or 2 for planar layouts, which only use x and y
+    int speakers[3];
+    double inverse[9];
+} vbap_face;
+
+int vbap_layout_directions(const char* spec, float* directions) {
+    for (int i = 0; i < VBAP_NUM_PRESETS; i++) {
+        if (strcmp(spec, VBAP_PRESETS[i].name) == 0) {
+            memcpy(directions, VBAP_PRESETS[i].directions,
+                   sizeof(float) * 2 * VBAP_PRESETS[i].count);
+            return VBAP_PRESETS[i].count;
+        }
+    }
+
+    int count = 0;
+    const char* text = spec;
+    while (*text) {
+        char* end;
+        float azimuth = strtof(text, &end);
+        if (end == text || *end != ':' || count == VBAP_MAX_SPEAKERS) {
+            return -1;
+        }
+        text = end + 1;
+        float elevation = strtof(text, &end);
+        if (end == text || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        directions[count * 2] = azimuth;
+        directions[count * 2 + 1] = elevation;
+        count++;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return count > 0 ? count : -1;
+}
+
+const char* vbap_preset_name(int index) {
+    return index < VBAP_NUM_PRESETS ? VBAP_PRESETS[index].name : NULL;
+}
+
+static void unit_vector(double azimuth, double elevation, double* v) {
+    azimuth *= M_PI / 180;
+    elevation *= M_PI / 180;
+    v[0] = cos(elevation) * cos(azimuth);
+    v[1] = cos(elevation) * sin(azimuth);
+    v[2] = sin(elevation);
+}
+
+static void speaker_vector(const vbap_layout* layout, int s, double* v) {
+    unit_vector(layout->speakers[s].azimuth, layout->speakers[s].elevation, v);
+}
+
+// Inverts the 3 x 3 matrix with columns a, b and c. Returns false if it is
+// singular, when the speakers are in a plane through the head.
+static bool invert3(const double* a, const double* b, const double* c, double* inverse) {
+    double det = a[0] * (b[1] * c[2] - b[2] * c[1]) - b[0] * (a[1] * c[2] - a[2] * c[1]) +
+                 c[0] * (a[1] * b[2] - a[2] * b[1]);
+    if (fabs(det) < 1e-6) {
+        return false;
+    }
+    // Rows of the inverse are the cross products of the other two columns
+    inverse[0] = (b[1] * c[2] - b[2] * c[1]) / det;
+    inverse[1] = (b[2] * c[0] - b[0] * c[2]) / det;
+    inverse[2] = (b[0] * c[1] - b[1] * c[0]) / det;
+    inverse[3] = (c[1] * a[2] - c[2] * a[1]) / det;
+    inverse[4] = (c[2] * a[0] - c[0] * a[2]) / det;
+    inverse[5] = (c[0] * a[1] - c[1] * a[0]) / det;
+    inverse[6] = (a[1] * b[2] - a[2] * b[1]) / det;
+    inverse[7] = (a[2] * b[0] - a[0] * b[2]) / det;
+    inverse[8] = (a[0] * b[1] - a[1] * b[0]) / det;
+    return true;
+}
+
+// Adds the triangle of speakers i, j and k, with unit vectors `v`, to
+// `faces` if its matrix inverts. Returns the count.
+static int add_face(vbap_face* faces, int count, const double (*v)[3], int i, int j, int k) {
+    vbap_face* face = &faces[count];
+    if (!invert3(v[i], v[j], v[k], face->inverse)) {
+        return count;
+    }
+    face->count = 3;
+    face->speakers[0] = i;
+    face->speakers[1] = j;
+    face->speakers[2] = k;
+    return count + 1;
+}
+
+// Triangles of the convex hull. Every plane through three speakers with
+// all the others on one side is a face of it, and the speakers in that
+// plane lie on a circle, the plane's cut through the sphere. More than
+// three of them, such as a ring at one elevation, make a polygon that is
+// split into triangles fanning out from one corner, once, from the plane's
+// lowest three speakers: the other triples in it would overlap those
+// triangles, and which one panned a direction would flip between them.
+// Returns the count.
+static int hull_faces(const vbap_layout* layout, vbap_face* faces) {
+    int n = layout->num_speakers;
+    double v[VBAP_MAX_SPEAKERS][3];
+    for (int s = 0; s < n; s++) {
+        speaker_vector(layout, s, v[s]);
+    }
+
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j < n; j++) {
+            for (int k = j + 1; k < n; k++) {
+                const double* a = v[i];
+                const double* b = v[j];
+                const double* c = v[k];
+                double normal[3] = {
+                    (b[1] - a[1]) * (c[2] - a[2]) - (b[2] - a[2]) * (c[1] - a[1]),
+                    (b[2] - a[2]) * (c[0] - a[0]) - (b[0] - a[0]) * (c[2] - a[2]),
+                    (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]),
+                };
+                double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                                     normal[2] * normal[2]);
+                if (length < 1e-12) {
+                    continue;
+                }
+                for (int d = 0; d < 3; d++) {
+                    normal[d] /= length;
+                }
+                // Planes through the head bound nothing
+                if (fabs(normal[0] * a[0] + normal[1] * a[1] + normal[2] * a[2]) < 1e-6) {
+                    continue;
+                }
+
+                bool above = false, below = false;
+                int polygon[VBAP_MAX_SPEAKERS];
+                int corners = 0;
+                for (int m = 0; m < n; m++) {
+                    double side = normal[0] * (v[m][0] - a[0]) + normal[1] * (v[m][1] - a[1]) +
+                                  normal[2] * (v[m][2] - a[2]);
+                    above |= side > 1e-9;
+                    below |= side < -1e-9;
+                    if (fabs(side) <= 1e-9) {
+                        polygon[corners++] = m;
+                    }
+                }
+                if ((above && below) || polygon[0] != i || polygon[1] != j || polygon[2] != k) {
+                    continue;
+                }
+                if (corners == 3) {
+                    count = add_face(faces, count, v, i, j, k);
+                    continue;
+                }
+
+                // Corners in order round the centre of the polygon
+                double centre[3] = { 0, 0, 0 };
+                for (int m = 0; m < corners; m++) {
+                    for (int d = 0; d < 3; d++) {
+                        centre[d] += v[polygon[m]][d] / corners;
+                    }
+                }
+                double x[3], y[3];
+                for (int d = 0; d < 3; d++) {
+                    x[d] = a[d] - centre[d];
+                }
+                y[0] = normal[1] * x[2] - normal[2] * x[1];
+                y[1] = normal[2] * x[0] - normal[0] * x[2];
+                y[2] = normal[0] * x[1] - normal[1] * x[0];
+                double angles[VBAP_MAX_SPEAKERS];
+                for (int m = 0; m < corners; m++) {
+                    const double* p = v[polygon[m]];
+                    double along = 0, across = 0;
+                    for (int d = 0; d < 3; d++) {
+                        along += (p[d] - centre[d]) * x[d];
+                        across += (p[d] - centre[d]) * y[d];
+                    }
+                    double angle = atan2(across, along);
+                    int speaker = polygon[m];
+                    int at = m;
+                    while (at > 0 && angles[at - 1] > angle) {
+                        angles[at] = angles[at - 1];
+                        polygon[at] = polygon[at - 1];
+                        at--;
+                    }
+                    angles[at] = angle;
+                    polygon[at] = speaker;
+                }
+                for (int m = 1; m + 1 < corners; m++) {
+                    count = add_face(faces, count, v, polygon[0], polygon[m], polygon[m + 1]);
+                }
+            }
+        }
+    }
+    return count;
+}
+
+// Pairs of speakers next to each other in azimuth. Returns the count.
+static int ring_faces(const vbap_layout* layout, vbap_face* faces) {
+    int n = layout->num_speakers;
+    int order[VBAP_MAX_SPEAKERS];
+    for (int s = 0; s < n; s++) {
+        int i = s;
+        while (i > 0 && layout->speakers[order[i - 1]].azimuth > layout->speakers[s].azimuth) {
+            order[i] = order[i - 1];
+            i--;
+        }
+        order[i] = s;
+    }
+
+    int count = 0;
+    for (int s = 0; s < n && n > 1; s++) {
+        double a[3], b[3];
+        speaker_vector(layout, order[s], a);
+        speaker_vector(layout, order[(s + 1) % n], b);
+        double det = a[0] * b[1] - a[1] * b[0];
+        // Opposite speakers leave a half circle to one of them
+        if (fabs(det) < 1e-6) {
+            continue;
+        }
+        vbap_face* face = &faces[count++];
+        face->count = 2;
+        face->speakers[0] = order[s];
+        face->speakers[1] = order[(s + 1) % n];
+        face->inverse[0] = b[1] / det;
+        face->inverse[1] = -b[0] / det;
+        face->inverse[3] = -a[1] / det;
+        face->inverse[4] = a[0] / det;
+    }
+    return count;
+}
+
+// Pans `direction` with the face needing the least negative gain, a face
+// that contains it if there is one. Returns whether there was.
+static bool pan_direction(const vbap_layout* layout, const vbap_face* faces, int num_faces,
+                          const double* direction, vbap_pan* pan) {
+    double best_gains[3] = { 0, 0, 0 };
+    double best_min = -INFINITY;
+    const vbap_face* best = NULL;
+    for (int f = 0; f < num_faces && best_min < 0; f++) {
+        double gains[3] = { 0, 0, 0 };
+        double least = INFINITY;
+        for (int k = 0; k < faces[f].count; k++) {
+            for (int j = 0; j < faces[f].count; j++) {
+                gains[k] += faces[f].inverse[k * 3 + j] * direction[j];
+            }
+            least = fmin(least, gains[k]);
+        }
+        if (least > best_min) {
+            best_min = least;
+            best = &faces[f];
+            memcpy(best_gains, gains, sizeof(gains));
+        }
+    }
+
+    memset(pan, 0, sizeof(vbap_pan));
+    double power = 0;
+    if (best) {
+        for (int k = 0; k < best->count; k++) {
+            pan->speakers[k] = (unsigned char)best->speakers[k];
+            best_gains[k] = fmax(best_gains[k], 0);
+            power += best_gains[k] * best_gains[k];
+        }
+    }
+    if (power < 1e-12) {
+        // No face, or none facing it: the nearest speaker alone
+        double nearest = -INFINITY;
+        for (int s = 0; s < layout->num_speakers; s++) {
+            double v[3];
+            speaker_vector(layout, s, v);
+            double dot = v[0] * direction[0] + v[1] * direction[1] + v[2] * direction[2];
+            if (dot > nearest) {
+                nearest = dot;
+                pan->speakers[0] = (unsigned char)s;
+            }
+        }
+        pan->gains[0] = 1;
+        return false;
+    }
+    for (int k = 0; k < best->count; k++) {
+        pan->gains[k] = (float)(best_gains[k] / sqrt(power));
+    }
+    return best_min > -1e-9;
+}
+
+// Largest change in any speaker's gain from pan `a` to pan `b`
+static double gain_change(const vbap_pan* a, const vbap_pan* b) {
+    double change[VBAP_MAX_SPEAKERS] = { 0 };
+    for (int k = 0; k < 3; k++) {
+        change[a->speakers[k]] += a->gains[k];
+        change[b->speakers[k]] -= b->gains[k];
+    }
+    double largest = 0;
+    for (int s = 0; s < VBAP_MAX_SPEAKERS; s++) {
+        largest = fmax(largest, fabs(change[s]));
+    }
+    return largest;
+}
+
+// Whether panning changes smoothly over the step from (azimuth, elevation),
+// panned as `start`, to `step` degrees on, panned as `end`. A step that
+// changes some gain by more than VBAP_MAX_JUMP is halved until the halves
+// are small enough, as any slope's are, or `depth` runs out on a jump.
+// Directions no face covers are left out.
+static bool smooth(const vbap_layout* layout, const vbap_face* faces, int num_faces,
+                   double azimuth, double elevation, const double* step, const vbap_pan* start,
+                   const vbap_pan* end, int depth) {
+    if (gain_change(start, end) <= VBAP_MAX_JUMP) {
+        return true;
+    }
+    if (depth == 0) {
+        return false;
+    }
+    double half[2] = { step[0] / 2, step[1] / 2 };
+    double direction[3];
+    unit_vector(azimuth + half[0], elevation + half[1], direction);
+    vbap_pan middle;
+    if (!pan_direction(layout, faces, num_faces, direction, &middle)) {
+        return true;
+    }
+    return smooth(layout, faces, num_faces, azimuth, elevation, half, start, &middle,
+                  depth - 1) &&
+           smooth(layout, faces, num_faces, azimuth + half[0], elevation + half[1], half,
+                  &middle, end, depth - 1);
+}
+
+int vbap_layout_init(vbap_layout* layout, const hrtf_set* set, const float* directions,
+                     int count) {
+    memset(layout, 0, sizeof(vbap_layout));
+    if (count < 1 || count > VBAP_MAX_SPEAKERS) {
+        return -1;
+    }
+
+    layout->planar = true;
+    for (int i = 0; i < count; i++) {
+        bool swap;
+        int p = hrtf_set_lookup(set, (int)lroundf(directions[i * 2]),
+                                (int)lroundf(directions[i * 2 + 1]), &swap);
+        bool merged = false;
+        for (int s = 0; s < layout->num_speakers; s++) {
+            merged |= layout->speakers[s].data == &set->positions[p] &&
+                      layout->speakers[s].swap == swap;
+        }
+        if (merged) {
+            continue;
+        }
+        vbap_speaker* speaker = &layout->speakers[layout->num_speakers++];
+        speaker->data = &set->positions[p];
+        speaker->swap = swap;
+        speaker->azimuth = swap ? 360 - speaker->data->azimuth : speaker->data->azimuth;
+        speaker->elevation = speaker->data->elevation;
+        layout->planar &= speaker->elevation == 0;
+    }
+
+    // Every triple of speakers could be a face of the hull
+    int n = layout->num_speakers;
+    int max_faces = layout->planar ? n : n * (n - 1) * (n - 2) / 6 + 1;
+    vbap_face* faces = malloc(sizeof(vbap_face) * max_faces);
+    layout->num_azimuths = 360 / VBAP_TABLE_STEP;
+    layout->num_elevations = 180 / VBAP_TABLE_STEP + 1;
+    layout->table = malloc(sizeof(vbap_pan) * layout->num_azimuths * layout->num_elevations);
+    if (!faces || !layout->table) {
+        free(faces);
+        vbap_layout_free(layout);
+        return -1;
+    }
+    int num_faces = layout->planar ? ring_faces(layout, faces) : hull_faces(layout, faces);
+
+    int num_entries = layout->num_azimuths * layout->num_elevations;
+    bool* covered = malloc(sizeof(bool) * num_entries);
+    if (!covered) {
+        free(faces);
+        vbap_layout_free(layout);
+        return -1;
+    }
+    for (int a = 0; a < layout->num_azimuths; a++) {
+        for (int e = 0; e < layout->num_elevations; e++) {
+            // Planar layouts pan by azimuth alone
+            double direction[3];
+            double elevation = layout->planar ? 0 : e * VBAP_TABLE_STEP - 90;
+            unit_vector(a * VBAP_TABLE_STEP, elevation, direction);
+            int entry = a * layout->num_elevations + e;
+            covered[entry] = pan_direction(layout, faces, num_faces, direction,
+                                           &layout->table[entry]);
+        }
+    }
+
+    // Faces that overlap or leave gaps show up as gains that jump between
+    // neighbouring entries, to the next azimuth and the next elevation up
+    bool jumps = false;
+    for (int entry = 0; entry < num_entries && !jumps; entry++) {
+        int a = entry / layout->num_elevations;
+        int e = entry % layout->num_elevations;
+        double elevation = layout->planar ? 0 : e * VBAP_TABLE_STEP - 90;
+        int right = (a + 1) % layout->num_azimuths * layout->num_elevations + e;
+        double across[2] = { VBAP_TABLE_STEP, 0 };
+        double up[2] = { 0, layout->planar ? 0 : VBAP_TABLE_STEP };
+        jumps = (covered[entry] && covered[right] &&
+                 !smooth(layout, faces, num_faces, a * VBAP_TABLE_STEP, elevation, across,
+                         &layout->table[entry], &layout->table[right], VBAP_JUMP_DEPTH)) ||
+                (e + 1 < layout->num_elevations && covered[entry] && covered[entry + 1] &&
+                 !smooth(layout, faces, num_faces, a * VBAP_TABLE_STEP, elevation, up,
+                         &layout->table[entry], &layout->table[entry + 1], VBAP_JUMP_DEPTH));
+        if (jumps) {
+            printf("Virtual speaker gains jump near azimuth %d, elevation %d\n",
+                   a * VBAP_TABLE_STEP, (int)elevation);
+        }
+    }
+    free(covered);
+    free(faces);
+    if (jumps) {
+        vbap_layout_free(layout);
+        return -1;
+    }
+    return 0;
+}
+
+void vbap_layout_free(vbap_layout* layout) {
+    free(layout->table);
+    memset(layout, 0, sizeof(vbap_layout));
+}
+
+const vbap_pan* vbap_lookup(const vbap_layout* layout, float azimuth, float elevation) {
+    azimuth = fmodf(azimuth, 360);
+    if (azimuth < 0) {
+        azimuth += 360;
+    }
+    elevation = fminf(fmaxf(elevation, -90), 90);
+    int a = (int)lroundf(azimuth / VBAP_TABLE_STEP) % layout->num_azimuths;
+    int e = (int)lroundf((elevation + 90) / VBAP_TABLE_STEP);
+    return &layout->table[a * layout->num_elevations + e];
+}
@@ -0,0 +1,74 @@
+// Virtual loudspeakers
+// Another way to make rendering cost independent of the number of
+// sources: a fixed layout of virtual speakers, each played through the
+// measured HRIRs of its direction, with every source panned onto the
+// speakers around it by vector base amplitude panning (VBAP). A source in
+// the triangle of three speakers gets gains g solving g1 l1 + g2 l2 +
+// g3 l3 = p, where l are the speakers' unit vectors and p the source's,
+// scaled to constant power. A layout whose speakers are all on the
+// horizontal plane pans between neighbouring pairs instead.
+//
+// Speakers are snapped to the nearest measured positions of a set and
+// play that position's hrtf_data as it is (ears swapped for mirrored
+// ones), so a layout has no filters of its own. The triangles are the
+// faces of the speakers' convex hull, with faces of more than three
+// speakers, such as a ring's, split into triangles that do not overlap.
+// Directions no face covers, such as below the lowest ring, use the face
+// that needs the least negative gain, with the negative gains dropped.
+//
+// Panning is looked up in a table made with the layout, one entry per
+// VBAP_TABLE_STEP degrees of azimuth and elevation, so a source costs one
+// lookup and at most three gains per call.
+
+#ifndef VBAP_H
+#define VBAP_H
+
+#include "hrtf_cache.h"
+
+#define VBAP_MAX_SPEAKERS 32
+#define VBAP_TABLE_STEP 2
+
+typedef struct _vbap_speaker {
+    const hrtf_data* data;  // Position played, from the set's own storage
+    bool swap;              // Mirrored: the position's ears swapped
+    int azimuth;            // As measured
+    int elevation;
+} vbap_speaker;
+
+// Up to three speakers and their gains, unused ones at gain 0
+typedef struct _vbap_pan {
+    unsigned char speakers[3];
+    float gains[3];
+} vbap_pan;
+
+typedef struct _vbap_layout {
+    int num_speakers;
+    vbap_speaker speakers[VBAP_MAX_SPEAKERS];
+    bool planar;            // Every speaker at elevation 0, panned in pairs
+    int num_azimuths;       // Table size
+    int num_elevations;
+    vbap_pan* table;        // Azimuth-major, from elevation -90 up
+} vbap_layout;
+
+// Fills `directions` with (azimuth, elevation) pairs, in degrees, from the
+// name of a preset ("ring8", "7.1.4" or "sphere") or a list such as
+// "0:0,90:0,180:0,270:0,0:90". Returns the number of speakers, or -1 if
+// `spec` is neither.
+int vbap_layout_directions(const char* spec, float* directions);
+
+// Name of the index-th preset, NULL past the last
+const char* vbap_preset_name(int index);
+
+// Snaps `count` speakers at `directions` to the positions of `set`,
+// merging any that land on the same one, and builds the panning table.
+// The set must outlive the layout. Returns 0 on success, -1 if there are
+// no speakers or too many, allocation failed, or the table's gains jump
+// somewhere faces cover.
+int vbap_layout_init(vbap_layout* layout, const hrtf_set* set, const float* directions,
+                     int count);
+void vbap_layout_free(vbap_layout* layout);
+
+// Panning for a source at (azimuth, elevation), in degrees
+const vbap_pan* vbap_lookup(const vbap_layout* layout, float azimuth, float elevation);
+
+#endif
@@ -0,0 +1,347 @@
+// Memory-mapped WAV source
+// See wav_map.h
+
+#include "wav_map.h"
+#include "wav_riff.h"
+#include "simd.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Maps the whole file, fills in base and size
+static int map_file(wav_map* map, const char* path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return -1;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        CloseHandle(file);
+        return -1;
+    }
+    const void* base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!base) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return -1;
+    }
+    map->file = file;
+    map->mapping = mapping;
+    map->base = base;
+    map->size = (size_t)size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    // Read ahead now rather than fault page by page in the callback
+    madvise(base, st.st_size, MADV_WILLNEED);
+    map->base = base;
+    map->size = (size_t)st.st_size;
+#endif
+    return 0;
+}
+
+static Uint16 read_le16(const Uint8* p) {
+    return (Uint16)(p[0] | p[1] << 8);
+}
+
+static Uint32 read_le32(const Uint8* p) {
+    return (Uint32)p[0] | (Uint32)p[1] << 8 | (Uint32)p[2] << 16 | (Uint32)p[3] << 24;
+}
+
+// Finds the fmt and data chunks, and checks the samples can be read as
+// they are
+static int parse_header(wav_map* map, int sample_rate) {
+    const Uint8* base = map->base;
+    if (map->size < 12 || read_le32(base) != WAV_ID_RIFF || read_le32(base + 8) != WAV_ID_WAVE) {
+        return -1;
+    }
+
+    int tag = 0, bits = 0;
+    size_t next = 12;
+    while (next + 8 <= map->size) {
+        Uint32 id = read_le32(base + next);
+        size_t start = next + 8;
+        size_t size = read_le32(base + next + 4);
+        // Only what is in the file, if it was cut short
+        if (size > map->size - start) {
+            size = map->size - start;
+        }
+        next = start + size + (size & 1);
+
+        if (id == WAV_ID_FMT && size >= 16) {
+            tag = read_le16(base + start);
+            map->spec.channels = (Uint8)read_le16(base + start + 2);
+            map->spec.freq = (int)read_le32(base + start + 4);
+            bits = read_le16(base + start + 14);
+            // The real tag starts the subformat GUID
+            if (tag == WAV_TAG_EXTENSIBLE && size >= 40) {
+                tag = read_le16(base + start + 24);
+            }
+        } else if (id == WAV_ID_DATA) {
+            if (tag == WAV_TAG_PCM && bits == 16) {
+                map->spec.format = AUDIO_S16LSB;
+            } else if (tag == WAV_TAG_FLOAT && bits == 32) {
+                map->spec.format = AUDIO_F32LSB;
+            } else {
+                return -1;
+            }
+            if (map->spec.channels < 1 || map->spec.channels > 2 ||
+                    map->spec.freq != sample_rate) {
+                return -1;
+            }
+            map->data = base + start;
+            map->num_frames = (int)(size / (bits / 8 * map->spec.channels));
+            return map->num_frames > 0 ? 0 : -1;
+        }
+    }
+    return -1;
+}
+
+int wav_map_open(wav_map* map, const char* path, int sample_rate) {
+    memset(map, 0, sizeof(wav_map));
+    // The kernels read the samples as they are
+    if (SDL_BYTEORDER != SDL_LIL_ENDIAN) {
+        return -1;
+    }
+    if (map_file(map, path) < 0) {
+        return -1;
+    }
+    if (parse_header(map, sample_rate) < 0) {
+        wav_map_close(map);
+        return -1;
+    }
+    return 0;
+}
+
+void wav_map_close(wav_map* map) {
+    if (!map->base) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(map->base);
+    CloseHandle(map->mapping);
+    CloseHandle(map->file);
+#else
+    munmap((void*)map->base, map->size);
+#endif
+    memset(map, 0, sizeof(wav_map));
+}
+
+// How frames are laid out. The kernels sum the channels of a frame, and the
+// caller folds the scale to [-1, 1) and the average into the gains.
+typedef enum {
+    WAV_MAP_S16_MONO,
+    WAV_MAP_S16_STEREO,
+    WAV_MAP_F32_MONO,
+    WAV_MAP_F32_STEREO
+} wav_map_layout;
+
+typedef void (*wav_map_convert_fn)(const Uint8* in, wav_map_layout layout, float gain,
+                                   float step, float* out, int n);
+
+// Frames `first` to n - 1 of a conversion, the remainder of the SIMD
+// kernels
+static void convert_scalar(const Uint8* in, wav_map_layout layout, float gain, float step,
+                           float* out, int first, int n) {
+    for (int i = first; i < n; i++) {
+        float x;
+        Sint16 s[2];
+        float f[2];
+        switch (layout) {
+            case WAV_MAP_S16_MONO:
+                memcpy(s, in + i * 2, sizeof(Sint16));
+                x = s[0];
+                break;
+            case WAV_MAP_S16_STEREO:
+                memcpy(s, in + i * 4, sizeof(s));
+                x = (float)(s[0] + s[1]);
+                break;
+            case WAV_MAP_F32_MONO:
+                memcpy(&x, in + i * 4, sizeof(float));
+                break;
+            default:
+                memcpy(f, in + i * 8, sizeof(f));
+                x = f[0] + f[1];
+                break;
+        }
+        out[i] = x * (gain + step * (i + 1));
+    }
+}
+
+static void wav_map_convert_scalar(const Uint8* in, wav_map_layout layout, float gain,
+                                   float step, float* out, int n) {
+    convert_scalar(in, layout, gain, step, out, 0, n);
+}
+
+// The SIMD kernels load a vector of frames, summing the channels of stereo
+// ones, and multiply by the ramp for those frames. Samples may be only two
+// bytes aligned, so every load is unaligned.
+#ifdef SIMD_X86
+SIMD_TARGET("sse2")
+static void wav_map_convert_sse2(const Uint8* in, wav_map_layout layout, float gain,
+                                 float step, float* out, int n) {
+    __m128 lanes = _mm_setr_ps(1, 2, 3, 4);
+    __m128i ones = _mm_set1_epi16(1);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x;
+        if (layout == WAV_MAP_S16_MONO) {
+            // Each sample into the top of a 32-bit lane, then shifted down
+            // with its sign
+            __m128i s = _mm_loadl_epi64((const __m128i*)(in + i * 2));
+            x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+        } else if (layout == WAV_MAP_S16_STEREO) {
+            __m128i s = _mm_loadu_si128((const __m128i*)(in + i * 4));
+            x = _mm_cvtepi32_ps(_mm_madd_epi16(s, ones));
+        } else if (layout == WAV_MAP_F32_MONO) {
+            x = _mm_loadu_ps((const float*)(in + i * 4));
+        } else {
+            __m128 a = _mm_loadu_ps((const float*)(in + i * 8));
+            __m128 b = _mm_loadu_ps((const float*)(in + i * 8 + 16));
+            x = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+                           _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+        __m128 ramp = _mm_add_ps(_mm_set1_ps(gain),
+                                 _mm_mul_ps(_mm_set1_ps(step),
+                                            _mm_add_ps(_mm_set1_ps((float)i), lanes)));
+        _mm_storeu_ps(out + i, _mm_mul_ps(x, ramp));
+    }
+    convert_scalar(in, layout, gain, step, out, i, n);
+}
+
+SIMD_TARGET("avx2,fma")
+static void wav_map_convert_avx2(const Uint8* in, wav_map_layout layout, float gain,
+                                 float step, float* out, int n) {
+    __m256 lanes = _mm256_setr_ps(1, 2, 3, 4, 5, 6, 7, 8);
+    __m256i ones = _mm256_set1_epi16(1);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x;
+        if (layout == WAV_MAP_S16_MONO) {
+            __m128i s = _mm_loadu_si128((const __m128i*)(in + i * 2));
+            x = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(s));
+        } else if (layout == WAV_MAP_S16_STEREO) {
+            // Pairs are summed within each 128-bit lane, so frames stay in order
+            __m256i s = _mm256_loadu_si256((const __m256i*)(in + i * 4));
+            x = _mm256_cvtepi32_ps(_mm256_madd_epi16(s, ones));
+        } else if (layout == WAV_MAP_F32_MONO) {
+            x = _mm256_loadu_ps((const float*)(in + i * 4));
+        } else {
+            // The sums come out as frames 0 1 4 5 | 2 3 6 7, put back in
+            // order two at a time
+            __m256 a = _mm256_loadu_ps((const float*)(in + i * 8));
+            __m256 b = _mm256_loadu_ps((const float*)(in + i * 8 + 32));
+            __m256d sums = _mm256_castps_pd(_mm256_hadd_ps(a, b));
+            x = _mm256_castpd_ps(_mm256_permute4x64_pd(sums, _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+        __m256 ramp = _mm256_fmadd_ps(_mm256_set1_ps(step),
+                                      _mm256_add_ps(_mm256_set1_ps((float)i), lanes),
+                                      _mm256_set1_ps(gain));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(x, ramp));
+    }
+    convert_scalar(in, layout, gain, step, out, i, n);
+}
+#endif
+
+#ifdef SIMD_NEON
+static void wav_map_convert_neon(const Uint8* in, wav_map_layout layout, float gain,
+                                 float step, float* out, int n) {
+    const float LANES[4] = { 1, 2, 3, 4 };
+    float32x4_t lanes = vld1q_f32(LANES);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t x;
+        if (layout == WAV_MAP_S16_MONO) {
+            x = vcvtq_f32_s32(vmovl_s16(vld1_s16((const int16_t*)(in + i * 2))));
+        } else if (layout == WAV_MAP_S16_STEREO) {
+            int16x4x2_t s = vld2_s16((const int16_t*)(in + i * 4));
+            x = vcvtq_f32_s32(vaddl_s16(s.val[0], s.val[1]));
+        } else if (layout == WAV_MAP_F32_MONO) {
+            x = vld1q_f32((const float*)(in + i * 4));
+        } else {
+            float32x4x2_t f = vld2q_f32((const float*)(in + i * 8));
+            x = vaddq_f32(f.val[0], f.val[1]);
+        }
+        float32x4_t ramp = vmlaq_n_f32(vdupq_n_f32(gain),
+                                       vaddq_f32(vdupq_n_f32((float)i), lanes), step);
+        vst1q_f32(out + i, vmulq_f32(x, ramp));
+    }
+    convert_scalar(in, layout, gain, step, out, i, n);
+}
+#endif
+
+static wav_map_convert_fn convert_kernel = wav_map_convert_scalar;
+static const char* convert_name = "scalar";
+
+void wav_map_init(void) {
+    convert_kernel = wav_map_convert_scalar;
+    convert_name = "scalar";
+
+#ifdef SIMD_X86
+    if (SDL_HasAVX2() && simd_has_fma()) {
+        convert_kernel = wav_map_convert_avx2;
+        convert_name = "AVX2";
+    } else if (SDL_HasSSE2()) {
+        convert_kernel = wav_map_convert_sse2;
+        convert_name = "SSE2";
+    }
+#endif
+#ifdef SIMD_NEON
+    if (SDL_HasNEON()) {
+        convert_kernel = wav_map_convert_neon;
+        convert_name = "NEON";
+    }
+#endif
+}
+
+const char* wav_map_kernel_name(void) {
+    return convert_name;
+}
+
+void wav_map_convert(const wav_map* map, int first, int n, float gain, float step, float* out) {
+    bool stereo = map->spec.channels == 2;
+    wav_map_layout layout;
+    float scale;
+    if (map->spec.format == AUDIO_S16LSB) {
+        layout = stereo ? WAV_MAP_S16_STEREO : WAV_MAP_S16_MONO;
+        scale = 1.0f / 32768;
+    } else {
+        layout = stereo ? WAV_MAP_F32_STEREO : WAV_MAP_F32_MONO;
+        scale = 1.0f;
+    }
+    if (stereo) {
+        scale *= 0.5f;
+    }
+    int frame_size = SDL_AUDIO_BITSIZE(map->spec.format) / 8 * map->spec.channels;
+    convert_kernel(map->data + (size_t)first * frame_size, layout, gain * scale, step * scale,
+                   out, n);
+}
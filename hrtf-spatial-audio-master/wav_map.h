@@ -0,0 +1,50 @@
+// Memory-mapped WAV source
+// A file already in a format the mixer can read needs no copy at all, not
+// even a wav_stream's ring. A wav_map maps it read-only, like hrtf_db, and
+// finds the samples inside the mapping. The mixer reads them from there as
+// it fills each voice's input: wav_map_convert() turns int16 or float32
+// samples into mono float, averaging stereo, and applies the voice's gain
+// ramp in the same pass, with a SIMD kernel picked at runtime like the
+// others. The pages are the page cache's, so any number of voices and
+// processes playing the same file share them, with nothing on the heap.
+//
+// Only 16-bit PCM and 32-bit float files, mono or stereo, at the device's
+// rate can be mapped. Anything else is refused, for a wav_stream to play.
+// Where the system allows it the whole file is asked to be paged in when it
+// is mapped, but pages dropped since are faulted in again by the audio
+// callback.
+
+#ifndef WAV_MAP_H
+#define WAV_MAP_H
+
+#include "SDL2/include/SDL.h"
+
+#include <stddef.h>
+
+typedef struct _wav_map {
+    SDL_AudioSpec spec;     // AUDIO_S16LSB or AUDIO_F32LSB, 1 or 2 channels
+    const Uint8* data;      // First sample, inside the mapping
+    int num_frames;
+
+    const Uint8* base;      // Start of the mapping, NULL when closed
+    size_t size;
+    void* file;             // Platform handles
+    void* mapping;
+} wav_map;
+
+// Maps `path` if it holds samples the mixer can read as they are at
+// `sample_rate`. Returns 0 on success, -1 otherwise.
+int wav_map_open(wav_map* map, const char* path, int sample_rate);
+void wav_map_close(wav_map* map);
+
+// Chooses how wav_map_convert() converts, see simd.h. The mixer calls it
+// when it sets up its voices.
+void wav_map_init(void);
+const char* wav_map_kernel_name(void);
+
+// Converts `n` frames from `first` on into mono float in `out`, times a
+// gain ramping from one step past `gain`:
+//     out[i] = sample(first + i) * (gain + step * (i + 1))
+void wav_map_convert(const wav_map* map, int first, int n, float gain, float step, float* out);
+
+#endif
@@ -0,0 +1,21 @@
+// WAV file layout
+// A RIFF header, "WAVE", then chunks of an ID, a length and that many
+// bytes, padded to an even length. The fmt chunk describes the samples,
+// which follow in the data chunk. Everything is little-endian.
+
+#ifndef WAV_RIFF_H
+#define WAV_RIFF_H
+
+// Chunk IDs, as little-endian words
+#define WAV_ID_RIFF 0x46464952
+#define WAV_ID_WAVE 0x45564157
+#define WAV_ID_FMT 0x20746D66
+#define WAV_ID_DATA 0x61746164
+
+// Sample formats in the fmt chunk. Extensible files give the real one at
+// the start of their subformat GUID.
+#define WAV_TAG_PCM 0x0001
+#define WAV_TAG_FLOAT 0x0003
+#define WAV_TAG_EXTENSIBLE 0xFFFE
+
+#endif
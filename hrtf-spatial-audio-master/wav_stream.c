@@ -0,0 +1,246 @@
+// Streaming WAV source
+// See wav_stream.h
+
+#include "wav_stream.h"
+#include "wav_riff.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What the converter is given. 24-bit samples are widened to 32 on the way.
+static SDL_AudioFormat wav_format(int tag, int bits) {
+    if (tag == WAV_TAG_PCM) {
+        return bits == 8 ? AUDIO_U8 : bits == 16 ? AUDIO_S16LSB :
+               bits == 24 || bits == 32 ? AUDIO_S32LSB : 0;
+    }
+    if (tag == WAV_TAG_FLOAT && bits == 32) {
+        return AUDIO_F32LSB;
+    }
+    return 0;
+}
+
+// Reads the fmt chunk into spec and finds the data chunk, skipping any
+// other chunks. Leaves the file anywhere.
+static int parse_header(wav_stream* stream) {
+    SDL_RWops* file = stream->file;
+    Sint64 file_size = SDL_RWsize(file);
+    if (SDL_ReadLE32(file) != WAV_ID_RIFF) {
+        return -1;
+    }
+    SDL_ReadLE32(file);
+    if (SDL_ReadLE32(file) != WAV_ID_WAVE) {
+        return -1;
+    }
+
+    // Chunks are padded to an even length
+    Sint64 next = SDL_RWtell(file);
+    while (next + 8 <= file_size) {
+        SDL_RWseek(file, next, RW_SEEK_SET);
+        Uint32 id = SDL_ReadLE32(file);
+        Uint32 size = SDL_ReadLE32(file);
+        Sint64 start = SDL_RWtell(file);
+        next = start + size + (size & 1);
+
+        if (id == WAV_ID_FMT && size >= 16) {
+            int tag = SDL_ReadLE16(file);
+            stream->spec.channels = (Uint8)SDL_ReadLE16(file);
+            stream->spec.freq = (int)SDL_ReadLE32(file);
+            SDL_ReadLE32(file);
+            SDL_ReadLE16(file);
+            int bits = SDL_ReadLE16(file);
+            // The real tag starts the subformat GUID, after the size of the
+            // extension, the valid bits and the channel mask
+            if (tag == WAV_TAG_EXTENSIBLE && size >= 40) {
+                SDL_RWseek(file, 8, RW_SEEK_CUR);
+                tag = SDL_ReadLE16(file);
+            }
+            stream->spec.format = wav_format(tag, bits);
+            stream->frame_size = bits / 8 * stream->spec.channels;
+            if (!stream->spec.format) {
+                printf("Unsupported WAV format %d with %d bits\n", tag, bits);
+                return -1;
+            }
+        } else if (id == WAV_ID_DATA) {
+            // Only what is in the file, if it was cut short
+            stream->data_start = start;
+            stream->data_len = start + size > file_size ? (Uint32)(file_size - start) : size;
+            break;
+        }
+    }
+
+    if (!stream->spec.format || stream->spec.channels == 0 || stream->spec.freq <= 0) {
+        return -1;
+    }
+    stream->data_len -= stream->data_len % stream->frame_size;
+    return stream->data_len > 0 ? 0 : -1;
+}
+
+// Widens n packed 24-bit samples to 32 bits in place, from the last down so
+// none is overwritten before it is read
+static void widen_24(Uint8* samples, int n) {
+    for (int i = n - 1; i >= 0; i--) {
+        Uint32 value = (Uint32)samples[i * 3] << 8 | (Uint32)samples[i * 3 + 1] << 16 |
+                       (Uint32)samples[i * 3 + 2] << 24;
+        samples[i * 4] = (Uint8)value;
+        samples[i * 4 + 1] = (Uint8)(value >> 8);
+        samples[i * 4 + 2] = (Uint8)(value >> 16);
+        samples[i * 4 + 3] = (Uint8)(value >> 24);
+    }
+}
+
+// Tops up the ring, with samples already converted first, then by reading
+// and converting more of the file, until the ring is full or a stream that
+// does not loop has ended
+static void refill(wav_stream* stream) {
+    int frame_size = stream->frame_size;
+    int widened_size = SDL_AUDIO_BITSIZE(stream->spec.format) / 8 * stream->spec.channels;
+    // Whole frames that still fit the chunk once widened
+    int chunk_len = WAV_STREAM_CHUNK / widened_size * frame_size;
+
+    while (!SDL_AtomicGet(&stream->ended)) {
+        int converted = SDL_AudioStreamAvailable(stream->convert);
+        // Only a stream that does not loop stays at the end, flushed
+        if (converted == 0 && stream->data_pos == stream->data_len) {
+            SDL_AtomicSet(&stream->ended, 1);
+            return;
+        }
+        int space = sample_ring_space(&stream->ring) * (int)sizeof(float);
+        if (space == 0) {
+            return;
+        }
+
+        if (converted > 0) {
+            int len = converted < space ? converted : space;
+            if (len > WAV_STREAM_CHUNK) {
+                len = WAV_STREAM_CHUNK;
+            }
+            len = SDL_AudioStreamGet(stream->convert, stream->chunk, len);
+            if (len <= 0) {
+                return;
+            }
+            sample_ring_write(&stream->ring, (const float*)stream->chunk, len / sizeof(float));
+            continue;
+        }
+
+        Uint32 len = stream->data_len - stream->data_pos;
+        if (len > (Uint32)chunk_len) {
+            len = chunk_len;
+        }
+        size_t got = SDL_RWread(stream->file, stream->chunk, 1, len);
+        got -= got % frame_size;
+        size_t widened = got / frame_size * widened_size;
+        if (widened != got) {
+            widen_24(stream->chunk, (int)(got / 3));
+        }
+        if (got == 0 || SDL_AudioStreamPut(stream->convert, stream->chunk, (int)widened) < 0) {
+            // A file that cannot be read any further ends here, looping or not
+            stream->data_len = stream->data_pos;
+            stream->loop = false;
+        } else {
+            stream->data_pos += (Uint32)got;
+        }
+        if (stream->data_pos < stream->data_len) {
+            continue;
+        }
+        if (stream->loop) {
+            SDL_RWseek(stream->file, stream->data_start, RW_SEEK_SET);
+            stream->data_pos = 0;
+        } else {
+            SDL_AudioStreamFlush(stream->convert);
+        }
+    }
+}
+
+static int reader_thread(void* data) {
+    wav_stream* stream = data;
+
+    while (!SDL_AtomicGet(&stream->quit)) {
+        SDL_SemWait(stream->wake);
+        // Cleared first, so a callback running the ring down during the
+        // refill wakes it again
+        SDL_AtomicSet(&stream->hungry, 0);
+        refill(stream);
+    }
+    return 0;
+}
+
+int wav_stream_open(wav_stream* stream, const char* path, int sample_rate, int ring_len,
+                    bool loop) {
+    memset(stream, 0, sizeof(wav_stream));
+    stream->file = SDL_RWFromFile(path, "rb");
+    if (!stream->file) {
+        return -1;
+    }
+    if (parse_header(stream) < 0) {
+        wav_stream_close(stream);
+        return -1;
+    }
+    stream->num_samples = (int)((Sint64)(stream->data_len / stream->frame_size) * sample_rate /
+                                stream->spec.freq);
+    stream->loop = loop;
+
+    stream->convert = SDL_NewAudioStream(stream->spec.format, stream->spec.channels,
+                                         stream->spec.freq, AUDIO_F32SYS, 1, sample_rate);
+    stream->chunk = malloc(WAV_STREAM_CHUNK);
+    if (!stream->convert || !stream->chunk || sample_ring_init(&stream->ring, ring_len) < 0) {
+        wav_stream_close(stream);
+        return -1;
+    }
+
+    // The first ring is ready before anything plays
+    SDL_RWseek(stream->file, stream->data_start, RW_SEEK_SET);
+    refill(stream);
+
+    stream->wake = SDL_CreateSemaphore(0);
+    if (!stream->wake) {
+        wav_stream_close(stream);
+        return -1;
+    }
+    stream->thread = SDL_CreateThread(reader_thread, "wav stream", stream);
+    if (!stream->thread) {
+        wav_stream_close(stream);
+        return -1;
+    }
+    return 0;
+}
+
+void wav_stream_close(wav_stream* stream) {
+    if (stream->thread) {
+        SDL_AtomicSet(&stream->quit, 1);
+        SDL_SemPost(stream->wake);
+        SDL_WaitThread(stream->thread, NULL);
+    }
+    if (stream->wake) {
+        SDL_DestroySemaphore(stream->wake);
+    }
+    if (stream->convert) {
+        SDL_FreeAudioStream(stream->convert);
+    }
+    if (stream->file) {
+        SDL_RWclose(stream->file);
+    }
+    free(stream->chunk);
+    sample_ring_free(&stream->ring);
+    memset(stream, 0, sizeof(wav_stream));
+}
+
+int wav_stream_read(wav_stream* stream, float* out, int n) {
+    int got = sample_ring_read(&stream->ring, out, n);
+    // Samples written before the end was flagged are all in the ring
+    bool ended = SDL_AtomicGet(&stream->ended);
+    if (got < n && !ended) {
+        stream->underruns++;
+    }
+
+    // One wake per time the ring runs low
+    if (!ended && sample_ring_available(&stream->ring) < stream->ring.size / 2 &&
+            SDL_AtomicCAS(&stream->hungry, 0, 1)) {
+        SDL_SemPost(stream->wake);
+    }
+    return got;
+}
+
+bool wav_stream_finished(wav_stream* stream) {
+    return SDL_AtomicGet(&stream->ended) && sample_ring_available(&stream->ring) == 0;
+}
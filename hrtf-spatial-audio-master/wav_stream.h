@@ -0,0 +1,73 @@
+// Streaming WAV source
+// SDL_LoadWAV() reads a whole file into memory, and converting it makes a
+// second copy, so memory grows with the length of the sound. A wav_stream
+// keeps only a ring of converted samples instead. A thread of its own
+// reads the file through SDL_RWops a chunk at a time, converts it to mono
+// float at the device's rate with an SDL_AudioStream, and tops up the
+// ring. The callback takes samples from the ring with wav_stream_read(),
+// which never blocks: when the ring runs half empty it wakes the reader,
+// and if it ever runs dry the callback plays silence for what is missing
+// and counts an underrun.
+//
+// Opening a stream parses the RIFF header and fills the ring once before
+// the reader starts, so playback starts as soon as the first ring of
+// samples is ready, however long the file. A looping stream seeks back to
+// its first sample when it reaches the end and carries on through the
+// same converter, so the loop has no gap.
+//
+// Uncompressed 8, 16, 24 and 32-bit PCM and 32-bit float files are read,
+// in any channel count and rate SDL_AudioStream converts. SDL has no 24-bit
+// format, so those samples are widened to 32 bits before conversion.
+
+#ifndef WAV_STREAM_H
+#define WAV_STREAM_H
+
+#include "sample_ring.h"
+
+#include <stdbool.h>
+
+// Bytes read from the file at a time, rounded down to whole frames
+#define WAV_STREAM_CHUNK 16384
+
+typedef struct _wav_stream {
+    SDL_AudioSpec spec;     // The file's format as converted, channels and rate
+    int frame_size;         // Bytes per frame in the file
+    int num_samples;        // Length once converted, to within a block
+
+    // Reader thread only, once it has started
+    SDL_RWops* file;
+    SDL_AudioStream* convert;
+    Sint64 data_start;      // Offset of the first sample in the file
+    Uint32 data_len;        // Bytes of samples
+    Uint32 data_pos;        // Bytes read since the start, or the last loop
+    bool loop;
+    Uint8* chunk;           // WAV_STREAM_CHUNK bytes, read or converted
+
+    sample_ring ring;
+    SDL_atomic_t ended;     // Every sample is in the ring, the file does not loop
+    SDL_atomic_t hungry;    // Set by the callback when it wakes the reader
+    int underruns;          // Callback only: reads the ring could not fill
+
+    SDL_atomic_t quit;
+    SDL_sem* wake;
+    SDL_Thread* thread;
+} wav_stream;
+
+// Opens `path`, converting to mono float at `sample_rate` through a ring of
+// `ring_len` samples, and starts the reader. Returns 0 on success, -1 if
+// the file cannot be read or parsed, its format is not supported, or
+// allocation failed.
+int wav_stream_open(wav_stream* stream, const char* path, int sample_rate, int ring_len,
+                    bool loop);
+
+// Stops the reader and closes the file. Nothing may be reading.
+void wav_stream_close(wav_stream* stream);
+
+// Callback side: reads up to `n` samples into `out` and returns how many
+// there were, fewer only past the end or on an underrun
+int wav_stream_read(wav_stream* stream, float* out, int n);
+
+// Callback side: true once a stream that does not loop has played out
+bool wav_stream_finished(wav_stream* stream);
+
+#endif